@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Host benchmark for the patch macros. Every macro is rendered
+ *              for a number of simulated milliseconds on various strip
+ *              sizes, while host time, heap usage and transmitted bytes
+ *              are recorded. Built by the native_bench environment.
+ *
+ */
+
+#ifdef NATIVE_BENCH
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <chrono>
+
+#include "config.h"
+#include "input.h"
+#include "strip.h"
+#include "patch_macros.h"
+#include "effect.h"
+#include "hal/native/native.h"
+
+////////////////////////
+// Heap Tracking
+////////////////////////
+
+// malloc, realloc and free are wrapped at link time (-Wl,--wrap=...).
+// Every allocation is prefixed by a header storing its size.
+
+#define HEAP_HDR sizeof(max_align_t)
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_realloc(void *ptr, size_t size);
+extern "C" void __real_free(void *ptr);
+
+static size_t heap_used = 0;
+static size_t heap_peak = 0;
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+        uint8_t *p = (uint8_t *)__real_malloc(size + HEAP_HDR);
+
+        if (!p)
+                return NULL;
+
+        *(size_t *)p = size;
+        heap_used += size;
+        if (heap_used > heap_peak)
+                heap_peak = heap_used;
+
+        return p + HEAP_HDR;
+}
+
+extern "C" void __wrap_free(void *ptr)
+{
+        if (!ptr)
+                return;
+
+        uint8_t *p = (uint8_t *)ptr - HEAP_HDR;
+        heap_used -= *(size_t *)p;
+        __real_free(p);
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size)
+{
+        if (!ptr)
+                return __wrap_malloc(size);
+
+        uint8_t *p = (uint8_t *)ptr - HEAP_HDR;
+        size_t prev = *(size_t *)p;
+
+        p = (uint8_t *)__real_realloc(p, size + HEAP_HDR);
+        if (!p)
+                return NULL;
+
+        *(size_t *)p = size;
+        heap_used = heap_used - prev + size;
+        if (heap_used > heap_peak)
+                heap_peak = heap_used;
+
+        return p + HEAP_HDR;
+}
+
+////////////////////////
+// Patches
+////////////////////////
+
+// Each macro is instantiated in its own render function, with its
+// own state, just like the PATCH() entries in config.h (see effect.cpp).
+#define BENCH_PATCH(NAME, STATE, ...) \
+        static STATE##_state bench_##NAME##_state; \
+        static void bench_##NAME##_init() \
+        { \
+                STATE##_init(&bench_##NAME##_state); \
+        } \
+        static void bench_##NAME##_render() \
+        { \
+                PATCH_STATE(STATE, &bench_##NAME##_state) \
+                __VA_ARGS__; \
+        }
+
+// Procedural patches, just like the PIXEL_PATCH() entries in config.h
+#define BENCH_PIXEL_PATCH(NAME, DELAY_MS, ...) \
+        static pixel_state bench_##NAME##_state; \
+        static void bench_##NAME##_pixel(void *state, uint16_t index, RGB_ptr_t rgb) \
+        { \
+                uint16_t t = ((pixel_state *)state)->t; \
+                (void)t; \
+                (void)index; \
+                __VA_ARGS__; \
+        } \
+        static void bench_##NAME##_init() \
+        { \
+                pixel_init(&bench_##NAME##_state); \
+        } \
+        static void bench_##NAME##_render() \
+        { \
+                strip_pixels(&bench_##NAME##_state, bench_##NAME##_pixel, DELAY_MS); \
+        }
+
+BENCH_PATCH(set_all, none, PATCH_SET_ALL(255, 0, 0))
+BENCH_PATCH(split, none, PATCH_SPLIT(255, 0, 0, 0, 0, 255, strip_size / 2))
+BENCH_PATCH(distribute, none, PATCH_DISTRIBUTE(RGB_ARRAY({255, 0, 0}, {0, 255, 0}, {0, 0, 255})))
+BENCH_PATCH(gradient, none, PATCH_GRADIENT(RGB_ARRAY({255, 0, 0}, {0, 255, 0}, {0, 0, 255})))
+BENCH_PATCH(dial_rgb, none, PATCH_DIAL_RGB(255))
+BENCH_PATCH(rainbow, rainbow, PATCH_ANIMATION_RAINBOW(1, 25, 255))
+BENCH_PATCH(rotate_rainbow, rainbow, PATCH_ANIMATION_ROTATE_RAINBOW(5, 50))
+BENCH_PATCH(swap, swap, PATCH_ANIMATION_SWAP(255, 0, 0, 0, 0, 255, 500))
+BENCH_PATCH(rain, rain, PATCH_ANIMATION_RAIN(0, 255, 255, strip_size, 5, 200, 10))
+BENCH_PATCH(twinkle, twinkle, PATCH_ANIMATION_TWINKLE(255, 255, 255, 5, 200, 10))
+BENCH_PATCH(override_arr, override, PATCH_ANIMATION_OVERRIDE_ARR(RGB_ARRAY({255, 0, 0}, {0, 0, 255}), 10))
+BENCH_PATCH(override_rand, override, PATCH_ANIMATION_OVERRIDE_RAND(10))
+BENCH_PATCH(override_rainbow, override_rainbow, PATCH_ANIMATION_OVERRIDE_RAINBOW(10, 20))
+BENCH_PATCH(fade, fade, PATCH_ANIMATION_FADE(255, 0, 0, 5, 1))
+BENCH_PATCH(breathe, breathe, PATCH_ANIMATION_BREATHE(255, 0, 0, 5, 1))
+BENCH_PATCH(breathe_rand, breathe, PATCH_ANIMATION_BREATHE_RAND(5, 1))
+BENCH_PATCH(breathe_rainbow, breathe_rainbow, PATCH_ANIMATION_BREATHE_RAINBOW(5, 1, 20))
+BENCH_PATCH(breathe_arr, breathe, PATCH_ANIMATION_BREATHE_ARR(RGB_ARRAY({255, 0, 0}, {0, 0, 255}), 5, 1))
+BENCH_PATCH(rainbow_pot, rainbow, PATCH_ANIMATION_RAINBOW_POT_CTRL)
+BENCH_PATCH(swap_pot, swap, PATCH_ANIMATION_SWAP_POT_CTRL(255, 0, 0, 0, 0, 255))
+BENCH_PATCH(rotate_rainbow_pot, rainbow, PATCH_ANIMATION_ROTATE_RAINBOW_POT_CTRL(95))
+BENCH_PATCH(rain_pot, rain, PATCH_ANIMATION_RAIN_POT_CTRL(0, 255, 255))
+BENCH_PATCH(override_arr_pot, override, PATCH_ANIMATION_OVERRIDE_ARR_POT_CTRL(RGB_ARRAY({255, 0, 0}, {0, 0, 255})))
+BENCH_PATCH(override_rand_pot, override, PATCH_ANIMATION_OVERRIDE_RAND_POT_CTRL)
+BENCH_PATCH(override_rainbow_pot, override_rainbow, PATCH_ANIMATION_OVERRIDE_RAINBOW_POT_CTRL(20))
+BENCH_PIXEL_PATCH(pixel_set_all, 1, PIXEL_SET_ALL(255, 0, 0))
+BENCH_PIXEL_PATCH(pixel_split, 1, PIXEL_SPLIT(255, 0, 0, 0, 0, 255, strip_size / 2))
+BENCH_PIXEL_PATCH(pixel_rainbow, 25, PIXEL_RAINBOW(1))
+BENCH_PIXEL_PATCH(pixel_rotate_rainbow, 50, PIXEL_ROTATE_RAINBOW(32))
+
+#ifdef CV_INPUT_ADMUX_MSK
+BENCH_PATCH(set_all_gated, none, PATCH_SET_ALL_GATED(255, 0, 0, 0, 0, 255, 128))
+BENCH_PATCH(set_all_toggle_on_rise, swap, PATCH_SET_ALL_TOGGLE_ON_RISE(255, 0, 0, 0, 0, 255, 128))
+BENCH_PATCH(swap_on_rise, swap, PATCH_ANIMATION_SWAP_ON_RISE(255, 0, 0, 0, 0, 255, 128))
+BENCH_PATCH(move_div_on_rise, move_div, PATCH_ANIMATION_MOVE_DIV_ON_RISE(255, 0, 0, 4, 128))
+BENCH_PATCH(fade_on_rise, trigger_fade, PATCH_ANIMATION_FADE_ON_RISE(255, 0, 0, 1, 128))
+#endif
+
+typedef struct bench_patch {
+        const char *name;
+        void (*init)();
+        void (*render)();
+} bench_patch;
+
+static const bench_patch patches[] = {
+        {"PATCH_SET_ALL", bench_set_all_init, bench_set_all_render},
+        {"PATCH_SPLIT", bench_split_init, bench_split_render},
+        {"PATCH_DISTRIBUTE", bench_distribute_init, bench_distribute_render},
+        {"PATCH_GRADIENT", bench_gradient_init, bench_gradient_render},
+        {"PATCH_DIAL_RGB", bench_dial_rgb_init, bench_dial_rgb_render},
+        {"PATCH_ANIMATION_RAINBOW", bench_rainbow_init, bench_rainbow_render},
+        {"PATCH_ANIMATION_ROTATE_RAINBOW", bench_rotate_rainbow_init, bench_rotate_rainbow_render},
+        {"PATCH_ANIMATION_SWAP", bench_swap_init, bench_swap_render},
+        {"PATCH_ANIMATION_RAIN", bench_rain_init, bench_rain_render},
+        {"PATCH_ANIMATION_TWINKLE", bench_twinkle_init, bench_twinkle_render},
+        {"PATCH_ANIMATION_OVERRIDE_ARR", bench_override_arr_init, bench_override_arr_render},
+        {"PATCH_ANIMATION_OVERRIDE_RAND", bench_override_rand_init, bench_override_rand_render},
+        {"PATCH_ANIMATION_OVERRIDE_RAINBOW", bench_override_rainbow_init, bench_override_rainbow_render},
+        {"PATCH_ANIMATION_FADE", bench_fade_init, bench_fade_render},
+        {"PATCH_ANIMATION_BREATHE", bench_breathe_init, bench_breathe_render},
+        {"PATCH_ANIMATION_BREATHE_RAND", bench_breathe_rand_init, bench_breathe_rand_render},
+        {"PATCH_ANIMATION_BREATHE_RAINBOW", bench_breathe_rainbow_init, bench_breathe_rainbow_render},
+        {"PATCH_ANIMATION_BREATHE_ARR", bench_breathe_arr_init, bench_breathe_arr_render},
+        {"PATCH_ANIMATION_RAINBOW_POT_CTRL", bench_rainbow_pot_init, bench_rainbow_pot_render},
+        {"PATCH_ANIMATION_SWAP_POT_CTRL", bench_swap_pot_init, bench_swap_pot_render},
+        {"PATCH_ANIMATION_ROTATE_RAINBOW_POT_CTRL", bench_rotate_rainbow_pot_init, bench_rotate_rainbow_pot_render},
+        {"PATCH_ANIMATION_RAIN_POT_CTRL", bench_rain_pot_init, bench_rain_pot_render},
+        {"PATCH_ANIMATION_OVERRIDE_ARR_POT_CTRL", bench_override_arr_pot_init, bench_override_arr_pot_render},
+        {"PATCH_ANIMATION_OVERRIDE_RAND_POT_CTRL", bench_override_rand_pot_init, bench_override_rand_pot_render},
+        {"PATCH_ANIMATION_OVERRIDE_RAINBOW_POT_CTRL", bench_override_rainbow_pot_init, bench_override_rainbow_pot_render},
+        {"PIXEL_SET_ALL", bench_pixel_set_all_init, bench_pixel_set_all_render},
+        {"PIXEL_SPLIT", bench_pixel_split_init, bench_pixel_split_render},
+        {"PIXEL_RAINBOW", bench_pixel_rainbow_init, bench_pixel_rainbow_render},
+        {"PIXEL_ROTATE_RAINBOW", bench_pixel_rotate_rainbow_init, bench_pixel_rotate_rainbow_render},
+#ifdef CV_INPUT_ADMUX_MSK
+        {"PATCH_SET_ALL_GATED", bench_set_all_gated_init, bench_set_all_gated_render},
+        {"PATCH_SET_ALL_TOGGLE_ON_RISE", bench_set_all_toggle_on_rise_init, bench_set_all_toggle_on_rise_render},
+        {"PATCH_ANIMATION_SWAP_ON_RISE", bench_swap_on_rise_init, bench_swap_on_rise_render},
+        {"PATCH_ANIMATION_MOVE_DIV_ON_RISE", bench_move_div_on_rise_init, bench_move_div_on_rise_render},
+        {"PATCH_ANIMATION_FADE_ON_RISE", bench_fade_on_rise_init, bench_fade_on_rise_render},
+#endif
+};
+
+static const uint16_t sizes[] = {8, 64, 255, 1000};
+
+////////////////////////
+// CV Input
+////////////////////////
+
+#ifdef CV_INPUT_ADMUX_MSK
+
+// Period of the square wave fed into the CV input
+#define BENCH_CV_PERIOD_MS 500
+
+void ADC_vect(void);
+
+/* bench_cv
+ * --------
+ * Parameters:
+ *      ms - Simulated milliseconds passed since the patch was selected
+ * Description:
+ *      Completes a conversion of the CV input, just as the millisecond
+ *      tick triggers one on the target (see adc_sampler_start()). The
+ *      input alternates between 0 and 255 every half period, such
+ *      that triggered patches see a rising edge every period.
+ */
+static void bench_cv(unsigned long ms)
+{
+        ADCH = ((ms / (BENCH_CV_PERIOD_MS / 2)) & 1) ? 255 : 0;
+        ADC_vect();
+}
+
+#else
+#define bench_cv(ms)
+#endif
+
+////////////////////////
+// Main routine
+////////////////////////
+
+/* nsec
+ * ----
+ * Returns:
+ *      Monotonic host time in nanoseconds
+ */
+static double nsec()
+{
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration<double, std::nano>(now).count();
+}
+
+/* main
+ * ----
+ * Usage:
+ *      bench [ms]
+ * Description:
+ *      Renders every patch for the provided amount of simulated
+ *      milliseconds (default 10000) on every strip size, calling the
+ *      patch once per millisecond. Prints the host time per call and
+ *      per transmitted frame, the number of frames, the bytes
+ *      transmitted per frame and the peak heap usage. The host time
+ *      is taken once around the entire run, rather than per call,
+ *      keeping the clock's own overhead and resolution out of the
+ *      numbers. It includes advancing the simulated clock and, if
+ *      configured, feeding the CV input (see bench_cv()).
+ */
+int main(int argc, char *argv[])
+{
+        unsigned long ms = (argc > 1) ? strtoul(argv[1], NULL, 10) : 10000;
+
+        printf("%-42s %5s %10s %10s %8s %10s %8s\n",
+               "patch", "size", "ns/call", "ns/frame", "frames", "B/frame", "heap");
+
+        for (uint8_t p = 0; p < sizeof(patches)/sizeof(bench_patch); p++) {
+                for (uint8_t s = 0; s < sizeof(sizes)/sizeof(uint16_t); s++) {
+                        native_reset();
+                        srand(1);
+                        strip_size = sizes[s];
+                        patches[p].init();
+                        heap_peak = heap_used;
+
+                        size_t heap_base = heap_used;
+                        double host_ns = nsec();
+
+                        for (unsigned long i = 0; i < ms; i++) {
+                                bench_cv(i);
+                                patches[p].render();
+                                native_advance_ms(1);
+                        }
+
+                        host_ns = nsec() - host_ns;
+
+                        printf("%-42s %5u %10.1f %10.1f %8lu %10lu %8lu\n",
+                               patches[p].name,
+                               strip_size,
+                               host_ns / ms,
+                               native_frames_tx ? host_ns / native_frames_tx : 0,
+                               native_frames_tx,
+                               native_frames_tx ? native_bytes_tx / native_frames_tx : 0,
+                               (unsigned long)(heap_peak - heap_base));
+                }
+        }
+
+        return 0;
+}
+
+#endif
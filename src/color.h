@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Integer color math routines.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* scale8
+ * ------
+ * Parameters:
+ *      i - Value to be scaled
+ *      scale - Scale (0 = 0%, 255 = 100%)
+ * Returns:
+ *      i * scale / 255, rounded to the nearest integer
+ * Description:
+ *      Fixed point replacement for round(((double)scale/255) * i).
+ *      The division by 255 is carried out as
+ *      (v + 1 + (v >> 8)) >> 8, which is exact for all 16-bit v.
+ */
+static inline uint8_t scale8(uint8_t i, uint8_t scale)
+{
+        uint16_t v = (uint16_t)i * scale + 127;
+        return (v + 1 + (v >> 8)) >> 8;
+}
+
+/* nscale8x3
+ * ---------
+ * Parameters:
+ *      rgb - Three byte color value, scaled in place
+ *      scale - Scale (0 = 0%, 255 = 100%)
+ * Description:
+ *      Scales all three channels of a color value.
+ */
+static inline void nscale8x3(uint8_t *rgb, uint8_t scale)
+{
+        rgb[0] = scale8(rgb[0], scale);
+        rgb[1] = scale8(rgb[1], scale);
+        rgb[2] = scale8(rgb[2], scale);
+}
+
+/* blend8
+ * ------
+ * Parameters:
+ *      a - Value at amount 0
+ *      b - Value at amount 255
+ *      amount - Blend amount (0 = a, 255 = b)
+ * Returns:
+ *      a + (b - a) * amount / 256, exact at both ends
+ * Description:
+ *      Linear interpolation between two 8-bit values,
+ *      without divisions or signed arithmetic.
+ */
+static inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amount)
+{
+        uint16_t partial = ((uint16_t)a << 8) | b;
+
+        partial += (uint16_t)b * amount;
+        partial -= (uint16_t)a * amount;
+
+        return partial >> 8;
+}
@@ -50,6 +50,14 @@
                                                 // If runtime between strip writes exceeds the 
                                                 // necessary reset time, this may be set to 0
 
+// #define WS2812_GAMMA                         // Gamma correct (2.8) every transmitted value for perceptually linear fades.
+                                                // Costs a 256 byte lookup table in flash.
+// #define WS2812_MASTER_BRIGHTNESS 255         // Scale every transmitted value by a master brightness (0 - 255), which may
+                                                // be changed at runtime via ws2812_set_brightness().
+// #define WS2812_DITHER                        // Keep gamma and master brightness corrected values at 16 bit and dither the
+                                                // remainder over successive frames, smoothing fades at low brightness.
+                                                // Requires WS2812_GAMMA or WS2812_MASTER_BRIGHTNESS. Doubles the gamma table.
+
 //////////////////////////////
 // Potentiometer
 //////////////////////////////
@@ -57,20 +65,40 @@
 // Potentiometer input ADMUX mask
 #define BRIGHTNESS_POT_MISSING                  // No potentiometer
 
+#define ADC_FILTER_SHIFT 4                      // The pot and CV input are sampled every ms (alternately, if both are present) and
+                                                // averaged over ~2^ADC_FILTER_SHIFT samples. Higher values reduce noise, but respond slower (max 8).
+
 //////////////////////////////
 // Push Button
 //////////////////////////////
 
 #define BTN PB2                                                // Push button pin
 
-#define BTN_DEBOUNCE_TIME 100                                  // ms - Time to wait for button to debounce. Increasing this will reduce false trigger due to
-                                                               // bouncing, but add a slight delay to color toggling.
+#define BTN_DEBOUNCE_TIME 100                                  // ms - Time after a press or release during which further edges are ignored. Increasing this will
+                                                               // reduce false triggers due to bouncing, but limits how quickly the button may be clicked.
                                                                // Set to 0 or comment out to disable
+#define BTN_LONG_PRESS_MS 1000                                 // ms - Time the button must be held down for a long press (ex. to save the calibrated strip size)
+#define BTN_HOLD_REPEAT_MS 500                                 // ms - Period in which holding the button down after a long press repeats hold events
+#define BTN_DOUBLE_CLICK_MS 300                                // ms - Time after a click in which a further press counts as a double click
                                                 
 // #define BTN_MIN_RELEASED_READS 0                            // Reduce the read of false releases when holding down noisy push buttons. If your strip randomly
                                                                // toggles while holding the button, set this value higher. Increasing this will add a delay to
                                                                // button releases. Set to <= 1 or comment out to disable. 
                                                                
+//////////////////////////////
+// Power
+//////////////////////////////
+
+#define BOOT_COMMIT_MS 2000                                    // ms - Time the patch selected at power-up must run before the selection is saved.
+                                                               // Switching off earlier shows the same patch again at the next power-up.
+#define EEPROM_MIN_VCC_MV 4400                                 // mV - Minimum supply voltage for EEPROM writes, which are aborted below it.
+                                                               // Keep it above the brown-out level (4.3 V, see platformio.ini).
+                                                               // Set to 0 or comment out to disable
+// #define FAST_BOOT                                           // Show the first frame as early as possible, without fading it in. Skips the supply settle delay,
+                                                               // so requires the brown-out detector (see attiny85_fastboot in platformio.ini).
+// #define BOOT_TRACE_PIN PB1                                  // Toggle this port B pin at the end of every boot stage (reset, peripherals, settings,
+                                                               // strip size, first frame, commit), timestamping them for a logic analyzer.
+
 ////////////////////////
 // Patches
 ////////////////////////
@@ -78,19 +106,52 @@
 #define STRIP_SIZE 8
 #define HALF STRIP_SIZE/2
 
-// For a list of available patches, please refer to the
-// patch_macros.h header
-
-#define NUM_PATCHES 3 // Max 10 (To increase, add cases to update_strip() in main.c)
-
-
-#define PATCH_0 PATCH_ANIMATION_RAINBOW(1, 25, 255)
-#define PATCH_1 PATCH_ANIMATION_ROTATE_RAINBOW_POT_CTRL(95)
-
-// Cyan white rain effect with potentiometer intensity control
-#define PATCH_2 \
-        if (rand() % 2) { \
-                PATCH_ANIMATION_RAIN_POT_CTRL(0, 255, 255) \
-        } else { \
-                PATCH_ANIMATION_RAIN_POT_CTRL(255, 0, 255) \
-        }
+#define DROPSET_SIZE 8  // Maximum number of simultaneous rain droplets (max 15). Each droplet costs
+                        // 5 bytes of RAM, plus 4 bits per LED for the slot table.
+#define RLEBUF_RUNS 8   // Maximum number of runs in a run-length encoded frame (max 255), and thereby of colors
+                        // taken by PATCH_DISTRIBUTE and PATCH_GRADIENT. Each run costs 5 bytes of stack.
+
+// #define HUE_RAINBOW  // Map hues to the rainbow, which widens yellow and narrows green for a more even perceived
+                        // spread of colors, rather than to the evenly split RGB spectrum.
+
+#define FRAME_TIME_MS 1 // Time in ms between strip updates. The MCU idles in between to save power.
+                        // Animation delays are rounded up to a multiple of this value.
+
+#define FRAME_REFRESH_MS 1000   // Time in ms after which an unchanged frame is retransmitted to addressable strips,
+                                // which otherwise skip frames identical to the one shown (max 65535).
+
+// #define TRANSITION_TIME_MS 500    // Time in ms to crossfade between patches, including the fade in at power-up.
+                                     // Set to 0 or comment out to cut hard between patches. The outgoing patch keeps
+                                     // running during a transition, which doubles the RAM taken by patch states.
+                                     // Off by default, leaving the RAM of the second state block and the frame
+                                     // buffer to the stack of the larger patches. Only addressable strips support
+                                     // transitions.
+// #define TRANSITION_BUFFER_SIZE 48 // Bytes of RAM reserved for the two frames blended during a transition (6 bytes
+                                     // per LED). Longer strips blend pixel by pixel if both patches are
+                                     // procedural (see PIXEL_PATCH), else cut hard.
+#define EFFECT_RAM_BUDGET 256        // Bytes of RAM the patch states (two with transitions) and the transition buffer
+                                     // may take up together. Checked at compile time, leaving the rest of the 512
+                                     // bytes of the ATtiny85 to the stack and remaining globals.
+
+// Patches are listed as PATCH(name, state, ...) entries, where the name must be
+// unique, the state is the state required by the used patch macros (ex. rainbow,
+// rain, or none), and the remaining arguments form the body of the patch, made
+// up of the patch macros in the patch_macros.h header. The number of patches is
+// only limited by flash (max 255).
+//
+// Procedural patches are listed as PIXEL_PATCH(name, delay, ...) entries, where
+// the remaining arguments compute a single pixel from its index and the frame
+// count t, typically using the PIXEL_ macros in patch_macros.h. A frame is
+// rendered every delay ms. Procedural patches need no frame buffer, regardless
+// of the strip size.
+
+#define PATCHES \
+        PATCH(rainbow, rainbow, PATCH_ANIMATION_RAINBOW(1, 25, 255)) \
+        PIXEL_PATCH(rotate_rainbow, 50, PIXEL_ROTATE_RAINBOW(32)) \
+        /* Cyan white rain effect with potentiometer intensity control */ \
+        PATCH(rain, rain, \
+                if (rand() % 2) { \
+                        PATCH_ANIMATION_RAIN_POT_CTRL(0, 255, 255) \
+                } else { \
+                        PATCH_ANIMATION_RAIN_POT_CTRL(255, 0, 255) \
+                })
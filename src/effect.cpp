@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Table driven registry of the patches listed in config.h.
+ *              For every PATCH() entry, a render function and a
+ *              descriptor in flash are generated at compile time.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+#include "config.h"
+#include "input.h"
+#include "ws2812.h"
+#include "timer.h"
+#include "effect.h"
+
+////////////////////////
+// Patches
+////////////////////////
+
+// Init and render functions
+#define PATCH(NAME, STATE, ...) \
+        static void patch_##NAME##_init(void *state) \
+        { \
+                STATE##_init((STATE##_state *)state); \
+        } \
+        static void patch_##NAME##_render(void *state) \
+        { \
+                PATCH_STATE(STATE, state) \
+                __VA_ARGS__; \
+        }
+
+// Procedural patches additionally generate a pixel function,
+// rendered by strip_pixels() every DELAY_MS
+#define PIXEL_PATCH(NAME, DELAY_MS, ...) \
+        static void patch_##NAME##_pixel(void *state, uint16_t index, RGB_ptr_t rgb) \
+        { \
+                uint16_t t = ((pixel_state *)state)->t; \
+                (void)t; \
+                (void)index; \
+                __VA_ARGS__; \
+        } \
+        static void patch_##NAME##_init(void *state) \
+        { \
+                pixel_init((pixel_state *)state); \
+        } \
+        static void patch_##NAME##_render(void *state) \
+        { \
+                strip_pixels((pixel_state *)state, patch_##NAME##_pixel, DELAY_MS); \
+        }
+PATCHES
+#undef PATCH
+#undef PIXEL_PATCH
+
+// Descriptors
+#define PATCH(NAME, STATE, ...) {patch_##NAME##_init, patch_##NAME##_render, NULL, sizeof(STATE##_state)},
+#define PIXEL_PATCH(NAME, DELAY_MS, ...) {patch_##NAME##_init, patch_##NAME##_render, patch_##NAME##_pixel, sizeof(pixel_state)},
+static const effect effects[NUM_PATCHES] PROGMEM = {
+        PATCHES
+};
+#undef PATCH
+#undef PIXEL_PATCH
+
+// State block of a patch. Its size is that of the largest state,
+// rather than the sum of all, as states are never used at once.
+#define PATCH(NAME, STATE, ...) STATE##_state NAME;
+#define PIXEL_PATCH(NAME, DELAY_MS, ...) pixel_state NAME;
+typedef union effect_state {
+        PATCHES
+} effect_state;
+#undef PATCH
+#undef PIXEL_PATCH
+
+////////////////////////
+// Transitions
+////////////////////////
+
+// Transitions keep the outgoing patch running next
+// to the incoming one, each in its own slot
+#if defined(TRANSITION_TIME_MS) && TRANSITION_TIME_MS > 0 && STRIP_TYPE == WS2812
+#define TRANSITION
+#define NUM_SLOTS 2
+#ifndef TRANSITION_BUFFER_SIZE
+#define TRANSITION_BUFFER_SIZE 0
+#endif
+#else
+#define NUM_SLOTS 1
+#undef TRANSITION_BUFFER_SIZE
+#define TRANSITION_BUFFER_SIZE 0
+#endif
+
+#ifndef EFFECT_RAM_BUDGET
+#define EFFECT_RAM_BUDGET 256
+#endif
+
+// The host benchmark sizes the buffers for strips of 1000 LEDs
+#ifndef NATIVE_BENCH
+static_assert(NUM_SLOTS * sizeof(effect_state) + TRANSITION_BUFFER_SIZE <= EFFECT_RAM_BUDGET,
+              "Patch states and transition buffer exceed EFFECT_RAM_BUDGET (see config.h)");
+#endif
+
+/* effect_slot
+ * -----------
+ * Description:
+ *      A selected patch and its state block.
+ *      Unused slots have no render function.
+ */
+typedef struct effect_slot {
+        void (*render)(void *state);
+        pixel_fn pixel;
+        effect_state state;
+} effect_slot;
+
+static effect_slot slots[NUM_SLOTS];
+static uint8_t current = 0;
+
+#ifdef TRANSITION
+
+enum transition_mode {
+        TRANSITION_NONE,        // No transition in progress
+        TRANSITION_BUFFERED,    // Both patches are rendered into frame buffers, which are blended
+        TRANSITION_PIXEL        // Both patches compute every pixel on the fly, which are blended
+};
+
+static uint8_t transition = TRANSITION_NONE;
+static uint8_t transition_amount;       // Blend amount of the last transmitted frame
+static tmr_t transition_tmr;
+
+#if TRANSITION_BUFFER_SIZE > 0
+static uint8_t frames[TRANSITION_BUFFER_SIZE];
+#endif
+
+/* frame_len
+ * ---------
+ * Returns:
+ *      Number of bytes in a frame
+ */
+static inline uint16_t frame_len()
+{
+        return strip_size * 3;
+}
+
+/* buffered
+ * --------
+ * Returns:
+ *      True if a frame for each slot fits into
+ *      TRANSITION_BUFFER_SIZE bytes
+ */
+static inline bool buffered()
+{
+        return (uint32_t)frame_len() * NUM_SLOTS <= TRANSITION_BUFFER_SIZE;
+}
+
+#if TRANSITION_BUFFER_SIZE > 0
+
+/* frame
+ * -----
+ * Parameters:
+ *      slot - Slot index
+ * Returns:
+ *      Frame buffer of the slot, holding its last rendered frame
+ *      in the strip's color order
+ */
+static inline uint8_t *frame(uint8_t slot)
+{
+        return frames + slot * frame_len();
+}
+
+/* render_frame
+ * ------------
+ * Parameters:
+ *      slot - Slot index
+ * Returns:
+ *      True if the patch completed a frame
+ * Description:
+ *      Renders the patch of a slot into its frame buffer.
+ *      Pixels the patch doesn't transmit keep their previous
+ *      value, just like on the strip itself.
+ */
+static bool render_frame(uint8_t slot)
+{
+        if (!slots[slot].render)
+                return false;
+
+        ws2812_capture_start(frame(slot), frame_len());
+        slots[slot].render(&slots[slot].state);
+        return ws2812_capture_stop();
+}
+
+#endif
+
+/* transition_render
+ * -----------------
+ * Description:
+ *      Renders both the outgoing and incoming patch and transmits
+ *      their blend, linearly fading from the former to the latter
+ *      over TRANSITION_TIME_MS. The transition ends with the
+ *      incoming patch fully shown.
+ */
+static void transition_render()
+{
+        uint8_t prev = current ^ 1;
+        unsigned long elapsed = tmr_elapsed(&transition_tmr);
+        uint8_t amount = 255;
+
+        if (elapsed < TRANSITION_TIME_MS)
+                amount = elapsed * 255 / TRANSITION_TIME_MS;
+
+        transition_amount = amount;
+
+#if TRANSITION_BUFFER_SIZE > 0
+        if (transition == TRANSITION_BUFFERED) {
+                render_frame(prev);
+                render_frame(current);
+
+                uint8_t *a = frame(prev);
+                uint8_t *b = frame(current);
+                uint16_t len = frame_len();
+
+                ws2812_prep_tx();
+                for (uint16_t i = 0; i < len; i += 3) {
+                        uint8_t px[3];
+
+                        px[0] = blend8(a[i], b[i], amount);
+                        px[1] = blend8(a[i + 1], b[i + 1], amount);
+                        px[2] = blend8(a[i + 2], b[i + 2], amount);
+                        ws2812_tx_buffer(px, sizeof(px));
+                }
+                ws2812_end_tx();
+        }
+#endif
+
+        if (transition == TRANSITION_PIXEL) {
+                // Advance both patches, discarding their frames
+                uint8_t discard;
+
+                ws2812_capture_start(&discard, 0);
+                if (slots[prev].render)
+                        slots[prev].render(&slots[prev].state);
+                slots[current].render(&slots[current].state);
+                ws2812_capture_stop();
+
+                ws2812_prep_tx();
+                for (uint16_t i = 0; i < strip_size; i++) {
+                        RGB_t a = {0, 0, 0};
+                        RGB_t b;
+                        uint8_t px[3];
+
+                        if (slots[prev].pixel)
+                                slots[prev].pixel(&slots[prev].state, i, a);
+                        slots[current].pixel(&slots[current].state, i, b);
+
+                        px[0] = blend8(a[WS2812_WIRING_RGB_0], b[WS2812_WIRING_RGB_0], amount);
+                        px[1] = blend8(a[WS2812_WIRING_RGB_1], b[WS2812_WIRING_RGB_1], amount);
+                        px[2] = blend8(a[WS2812_WIRING_RGB_2], b[WS2812_WIRING_RGB_2], amount);
+                        ws2812_tx_buffer(px, sizeof(px));
+                }
+                ws2812_end_tx();
+        }
+
+        if (amount == 255)
+                transition = TRANSITION_NONE;
+}
+
+#if TRANSITION_BUFFER_SIZE > 0
+
+/* transition_freeze
+ * -----------------
+ * Parameters:
+ *      prev - Slot of the outgoing patch
+ * Description:
+ *      Interrupts a running buffered transition by storing
+ *      its last transmitted blend in the frame of the outgoing
+ *      slot and stopping the outgoing patch, so that the next
+ *      transition fades out of that still frame rather than
+ *      jumping to either of the two patches. The frame of the
+ *      other slot holds the frame of the patch that was faded
+ *      out, which is dropped.
+ */
+static void transition_freeze(uint8_t prev)
+{
+        uint8_t *a = frame(current);
+        uint8_t *b = frame(prev);
+        uint16_t len = frame_len();
+
+        for (uint16_t i = 0; i < len; i++)
+                b[i] = blend8(a[i], b[i], transition_amount);
+
+        slots[prev].render = NULL;
+        slots[prev].pixel = NULL;
+}
+
+#endif
+
+/* transition_start
+ * ----------------
+ * Description:
+ *      Starts a transition from the previously selected patch
+ *      to the current one. Before any patch has been selected,
+ *      the previous patch is black, unless FAST_BOOT is set,
+ *      in which case the first patch is shown right away. If
+ *      a buffered transition is still running, the new one
+ *      starts from its blended frame. If the strip is too long
+ *      to buffer both frames and either patch lacks a pixel
+ *      function, the patches are cut hard instead.
+ */
+static void transition_start()
+{
+        uint8_t prev = current ^ 1;
+
+#ifdef FAST_BOOT
+        if (!slots[prev].render) {
+                transition = TRANSITION_NONE;
+                return;
+        }
+#endif
+
+        if (buffered()) {
+#if TRANSITION_BUFFER_SIZE > 0
+                if (transition == TRANSITION_BUFFERED)
+                        transition_freeze(prev);
+
+                // The incoming patch starts off with what's on the strip
+                memcpy(frame(current), frame(prev), frame_len());
+#endif
+                transition = TRANSITION_BUFFERED;
+        } else if (slots[current].pixel && (!slots[prev].render || slots[prev].pixel)) {
+                transition = TRANSITION_PIXEL;
+        } else {
+                transition = TRANSITION_NONE;
+                return;
+        }
+
+        tmr_reset(&transition_tmr);
+}
+
+#endif
+
+////////////////////////
+// Functions
+////////////////////////
+
+/* effect_select
+ * -------------
+ * Parameters:
+ *      patch - Index of the patch in the PATCHES list
+ * Description:
+ *      Selects the patch to be rendered by effect_render().
+ *      The state block is cleared and initialized for the
+ *      patch, meaning a patch always starts from scratch
+ *      when selected. Out of range indices are ignored.
+ *      If TRANSITION_TIME_MS is set, the previous patch
+ *      keeps running until it has been faded out.
+ */
+void effect_select(uint8_t patch)
+{
+        if (patch >= NUM_PATCHES)
+                return;
+
+        effect e;
+        memcpy_P(&e, &effects[patch], sizeof(effect));
+
+#ifdef TRANSITION
+        current ^= 1;
+#endif
+
+        effect_slot *slot = &slots[current];
+
+        memset(&slot->state, 0, e.state_size);
+        e.init(&slot->state);
+
+        slot->render = e.render;
+        slot->pixel = e.pixel;
+
+#ifdef TRANSITION
+        transition_start();
+#endif
+}
+
+/* effect_render
+ * -------------
+ * Description:
+ *      Renders the selected patch. For animations,
+ *      this function must be called repeatedly.
+ */
+void effect_render()
+{
+#ifdef TRANSITION
+        if (transition != TRANSITION_NONE) {
+                transition_render();
+                return;
+        }
+
+#if TRANSITION_BUFFER_SIZE > 0
+        // Keep a copy of the frame on the strip for the next transition,
+        // recorded as the patch transmits it
+        if (buffered()) {
+                ws2812_record_start(frame(current), frame_len());
+                slots[current].render(&slots[current].state);
+                ws2812_capture_stop();
+                return;
+        }
+#endif
+#endif
+
+        if (slots[current].render)
+                slots[current].render(&slots[current].state);
+}
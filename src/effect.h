@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Table driven registry of the patches listed in config.h.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "config.h"
+#include "strip.h"
+
+/* effect
+ * ------
+ * Description:
+ *      Descriptor of a patch, stored in flash.
+ *      Both init and render receive the state
+ *      block of the patch, which holds state_size
+ *      bytes.
+ *      Procedural patches (see PIXEL_PATCH() in config.h)
+ *      additionally provide their pixel function, which
+ *      allows transitions on strips too long to buffer
+ *      two frames (see TRANSITION_BUFFER_SIZE). For all
+ *      other patches, pixel is NULL.
+ */
+typedef struct effect {
+        void (*init)(void *state);
+        void (*render)(void *state);
+        pixel_fn pixel;
+        uint16_t state_size;
+} effect;
+
+/* none_state
+ * ----------
+ * Description:
+ *      State of patches that require none.
+ */
+typedef uint8_t none_state;
+
+static inline void none_init(none_state *state)
+{
+        (void)state;
+}
+
+/* PATCH_STATE
+ * -----------
+ * Parameters:
+ *      STATE - State of the patch, as listed in its PATCH() entry
+ *      BLOCK - Pointer to the state block
+ * Description:
+ *      Declares the patch_state pointer the patch macros
+ *      operate on. As patch_state is typed, using a macro
+ *      with the wrong state fails to compile.
+ */
+#define PATCH_STATE(STATE, BLOCK) \
+        STATE##_state *patch_state = (STATE##_state *)(BLOCK); \
+        (void)patch_state;
+
+// One id per PATCH() and PIXEL_PATCH() entry in config.h, NUM_PATCHES being the number of entries
+#define PATCH(NAME, STATE, ...) PATCH_ID_##NAME,
+#define PIXEL_PATCH(NAME, DELAY_MS, ...) PATCH_ID_##NAME,
+enum patch_id {
+        PATCHES
+        NUM_PATCHES
+};
+#undef PATCH
+#undef PIXEL_PATCH
+
+void effect_select(uint8_t patch);
+void effect_render();
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Native stand-in for avr-libc's <avr/eeprom.h>.
+ *              EEMEM variables are placed in regular memory and
+ *              accessed directly.
+ *
+ *              A power loss can be simulated by limiting the number
+ *              of writes through native_eeprom_budget. Any writes
+ *              beyond it are lost and counted in native_eeprom_lost.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define EEMEM
+
+extern long native_eeprom_budget;       // Writes left before the power is lost, negative if unlimited
+extern unsigned long native_eeprom_lost; // Writes lost since the power has been lost
+
+static inline void native_eeprom_write(uint8_t *p, uint8_t value)
+{
+        if (native_eeprom_budget == 0) {
+                native_eeprom_lost++;
+                return;
+        }
+
+        if (native_eeprom_budget > 0)
+                native_eeprom_budget--;
+
+        *p = value;
+}
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p)
+{
+        return *p;
+}
+
+static inline uint16_t eeprom_read_word(const uint16_t *p)
+{
+        return *p;
+}
+
+static inline void eeprom_write_byte(uint8_t *p, uint8_t value)
+{
+        native_eeprom_write(p, value);
+}
+
+static inline void eeprom_write_word(uint16_t *p, uint16_t value)
+{
+        native_eeprom_write((uint8_t *)p, value & 0xFF);
+        native_eeprom_write((uint8_t *)p + 1, value >> 8);
+}
+
+static inline void eeprom_update_byte(uint8_t *p, uint8_t value)
+{
+        if (*p != value)
+                native_eeprom_write(p, value);
+}
+
+static inline void eeprom_update_word(uint16_t *p, uint16_t value)
+{
+        eeprom_update_byte((uint8_t *)p, value & 0xFF);
+        eeprom_update_byte((uint8_t *)p + 1, value >> 8);
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Native stand-in for avr-libc's <avr/interrupt.h>.
+ *              Interrupt service routines become plain functions
+ *              which may be invoked by the host.
+ *
+ */
+
+#pragma once
+
+#include "io.h"
+
+#define sei() (SREG |= _BV(SREG_I))
+#define cli() (SREG &= ~_BV(SREG_I))
+
+#define ISR(vector, ...) void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void) {}
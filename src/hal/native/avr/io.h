@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Native stand-in for avr-libc's <avr/io.h>. Maps the
+ *              ATtiny85 I/O registers onto a plain memory array.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "../native.h"
+
+#define _SFR_IO8(addr) (native_sfr[(addr)])
+#define _BV(bit) (1 << (bit))
+
+#define bit_is_set(sfr, bit) ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+// There is no peripheral to wait for, hardware flags are
+// cleared immediately (ex. ADC conversions complete instantly)
+#define loop_until_bit_is_set(sfr, bit) ((sfr) |= _BV(bit))
+#define loop_until_bit_is_clear(sfr, bit) ((sfr) &= ~_BV(bit))
+
+////////////////////////
+// Memories (ATtiny85)
+////////////////////////
+
+#define E2END 0x1FF     // Last EEPROM address
+
+////////////////////////
+// Registers (ATtiny85)
+////////////////////////
+
+#define ADCSRB  _SFR_IO8(0x03)
+#define ADCL    _SFR_IO8(0x04)
+#define ADCH    _SFR_IO8(0x05)
+#define ADCSRA  _SFR_IO8(0x06)
+#define ADMUX   _SFR_IO8(0x07)
+#define ACSR    _SFR_IO8(0x08)
+#define GPIOR0  _SFR_IO8(0x11)
+#define GPIOR1  _SFR_IO8(0x12)
+#define GPIOR2  _SFR_IO8(0x13)
+#define DIDR0   _SFR_IO8(0x14)
+#define PCMSK   _SFR_IO8(0x15)
+#define PINB    _SFR_IO8(0x16)
+#define DDRB    _SFR_IO8(0x17)
+#define PORTB   _SFR_IO8(0x18)
+#define EECR    _SFR_IO8(0x1C)
+#define EEDR    _SFR_IO8(0x1D)
+#define EEARL   _SFR_IO8(0x1E)
+#define EEARH   _SFR_IO8(0x1F)
+#define PRR     _SFR_IO8(0x20)
+#define WDTCR   _SFR_IO8(0x21)
+#define CLKPR   _SFR_IO8(0x26)
+#define PLLCSR  _SFR_IO8(0x27)
+#define OCR0B   _SFR_IO8(0x28)
+#define OCR0A   _SFR_IO8(0x29)
+#define TCCR0A  _SFR_IO8(0x2A)
+#define OCR1B   _SFR_IO8(0x2B)
+#define GTCCR   _SFR_IO8(0x2C)
+#define OCR1C   _SFR_IO8(0x2D)
+#define OCR1A   _SFR_IO8(0x2E)
+#define TCNT1   _SFR_IO8(0x2F)
+#define TCCR1   _SFR_IO8(0x30)
+#define OSCCAL  _SFR_IO8(0x31)
+#define TCNT0   _SFR_IO8(0x32)
+#define TCCR0B  _SFR_IO8(0x33)
+#define MCUSR   _SFR_IO8(0x34)
+#define MCUCR   _SFR_IO8(0x35)
+#define TIFR    _SFR_IO8(0x38)
+#define TIMSK   _SFR_IO8(0x39)
+#define GIFR    _SFR_IO8(0x3A)
+#define GIMSK   _SFR_IO8(0x3B)
+#define SREG    _SFR_IO8(0x3F)
+
+////////////////////////
+// Bits
+////////////////////////
+
+// PORTB/DDRB/PINB
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+
+// ADMUX
+#define MUX0  0
+#define MUX1  1
+#define MUX2  2
+#define MUX3  3
+#define REFS2 4
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+
+// ADCSRA
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE  3
+#define ADIF  4
+#define ADATE 5
+#define ADSC  6
+#define ADEN  7
+
+// ADCSRB
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+
+// TCCR0A
+#define WGM00  0
+#define WGM01  1
+#define COM0B0 4
+#define COM0B1 5
+#define COM0A0 6
+#define COM0A1 7
+
+// TCCR0B
+#define CS00  0
+#define CS01  1
+#define CS02  2
+#define WGM02 3
+
+// TIMSK/TIFR
+#define TOIE0  1
+#define TOIE1  2
+#define OCIE0B 3
+#define OCIE0A 4
+#define OCIE1B 5
+#define OCIE1A 6
+
+#define TOV0  1
+#define TOV1  2
+#define OCF0B 3
+#define OCF0A 4
+#define OCF1B 5
+#define OCF1A 6
+
+// PLLCSR
+#define PLOCK 0
+#define PLLE  1
+#define PCKE  2
+
+// TCCR1
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define CS13   3
+#define COM1A0 4
+#define COM1A1 5
+#define PWM1A  6
+#define CTC1   7
+
+// GTCCR
+#define COM1B0 4
+#define COM1B1 5
+#define PWM1B  6
+
+// MCUCR
+#define ISC00 0
+#define ISC01 1
+#define BODSE 2
+#define SM0   3
+#define SM1   4
+#define SE    5
+#define PUD   6
+#define BODS  7
+
+// MCUSR
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+
+// ACSR
+#define ACD 7
+
+// PRR
+#define PRADC  0
+#define PRUSI  1
+#define PRTIM0 2
+#define PRTIM1 3
+
+// GIMSK
+#define PCIE 5
+#define INT0 6
+
+// SREG
+#define SREG_I 7
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Host side register file and simulated clock for native builds.
+ *
+ */
+
+#ifdef NATIVE_BUILD
+
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "config.h"
+#include "native.h"
+#include "timer.h"
+
+volatile uint8_t native_sfr[64];
+
+long native_eeprom_budget = -1;
+unsigned long native_eeprom_lost = 0;
+
+static unsigned long long native_us = 0; // Simulated time in us
+
+/* native_reset
+ * ------------
+ * Description:
+ *      Resets all emulated registers, the simulated clock,
+ *      the EEPROM write budget and the frame capture
+ *      statistics. Pull-ups are assumed on all input
+ *      pins, meaning PINB reads high.
+ */
+void native_reset()
+{
+        memset((void *)native_sfr, 0, sizeof(native_sfr));
+        PINB = 0x3F;
+
+        native_us = 0;
+
+        native_eeprom_budget = -1;
+        native_eeprom_lost = 0;
+
+        native_frame_len = 0;
+        native_frames_tx = 0;
+        native_bytes_tx = 0;
+}
+
+/* native_advance_us
+ * -----------------
+ * Parameters:
+ *      us - Time in microseconds
+ * Description:
+ *      Advances the simulated clock.
+ */
+void native_advance_us(unsigned long us)
+{
+        native_us += us;
+}
+
+/* native_advance_ms
+ * -----------------
+ * Parameters:
+ *      ms - Time in milliseconds
+ * Description:
+ *      Advances the simulated clock.
+ */
+void native_advance_ms(unsigned long ms)
+{
+        native_us += (unsigned long long)ms * 1000;
+}
+
+/* micros
+ * ------
+ * Returns:
+ *      Microseconds passed on the simulated clock
+ */
+unsigned long micros()
+{
+        return native_us;
+}
+
+/* millis
+ * ------
+ * Returns:
+ *      Milliseconds passed on the simulated clock
+ */
+unsigned long millis()
+{
+        return native_us / 1000;
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Host side hardware abstraction layer for native builds.
+ *              Emulates the ATtiny85 I/O registers, EEPROM and delays,
+ *              and captures WS2812 transmissions into memory.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef NATIVE_BUILD
+
+// Maximum amount of bytes captured per frame (3 bytes per pixel)
+#ifndef NATIVE_FRAME_MAX_BYTES
+#define NATIVE_FRAME_MAX_BYTES (3 * 4096)
+#endif
+
+////////////////////////
+// Registers
+////////////////////////
+
+extern volatile uint8_t native_sfr[64];
+
+////////////////////////
+// Clock
+////////////////////////
+
+void native_advance_us(unsigned long us);
+void native_advance_ms(unsigned long ms);
+unsigned long micros();
+unsigned long millis();
+
+////////////////////////
+// WS2812 Frame Capture
+////////////////////////
+
+/* native_frame_sink_t
+ * -------------------
+ * Description:
+ *      Callback invoked by ws2812_end_tx() with the bytes of
+ *      every completed frame, in the order they were put
+ *      on the wire.
+ */
+typedef void (*native_frame_sink_t)(const uint8_t *frame, uint16_t len);
+
+extern uint8_t native_frame[NATIVE_FRAME_MAX_BYTES];   // Last completed frame
+extern uint16_t native_frame_len;                      // Length of the last completed frame
+extern unsigned long native_frames_tx;                 // Total completed frames
+extern unsigned long native_bytes_tx;                  // Total transmitted bytes
+extern native_frame_sink_t native_frame_sink;
+
+void native_reset();
+
+#endif
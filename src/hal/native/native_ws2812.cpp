@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Host implementation of the WS2812 driver routines.
+ *              Instead of toggling a pin, transmitted bytes are
+ *              captured into memory.
+ *
+ */
+
+#ifdef NATIVE_BUILD
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+#include "config.h"
+#include "ws2812.h"
+#include "native.h"
+
+#if STRIP_TYPE == WS2812
+
+#define WS2812_US_PER_BYTE 10 // 8 bits * 1.25 us
+
+uint8_t native_frame[NATIVE_FRAME_MAX_BYTES];
+uint16_t native_frame_len = 0;
+unsigned long native_frames_tx = 0;
+unsigned long native_bytes_tx = 0;
+native_frame_sink_t native_frame_sink = NULL;
+
+static uint8_t _sreg_prev;
+
+/* ws2812_prep_tx
+ * --------------
+ * Description:
+ *      Starts capturing a new frame.
+ *      Frames captured by ws2812_capture_start() are
+ *      neither counted nor handed to the frame sink.
+ */
+void ws2812_prep_tx()
+{
+#ifdef WS2812_CAPTURE
+        if (WS2812_CAPTURING) {
+                ws2812_capture_prep();
+                if (!ws2812_capture_tee)
+                        return;
+        }
+#endif
+
+        native_frame_len = 0;
+
+        _sreg_prev = SREG;
+        cli();
+}
+
+/* ws2812_wait_rst
+ * ---------------
+ * Description:
+ *      Advances the simulated clock by the WS2812 reset time.
+ */
+void ws2812_wait_rst()
+{
+#if defined(WS2812_RESET_TIME) && WS2812_RESET_TIME > 0
+        _delay_us(WS2812_RESET_TIME);
+#endif
+}
+
+/* ws2812_end_tx
+ * -------------
+ * Description:
+ *      Completes the captured frame and hands it to the
+ *      frame sink, if one is set. The simulated clock is
+ *      advanced by the time the transmission would have
+ *      taken on the wire.
+ */
+void ws2812_end_tx()
+{
+#ifdef WS2812_CAPTURE
+        if (WS2812_CAPTURING) {
+                ws2812_capture_end();
+                if (!ws2812_capture_tee)
+                        return;
+        }
+#endif
+
+        native_frames_tx++;
+        native_advance_us((unsigned long)native_frame_len * WS2812_US_PER_BYTE);
+
+        if (native_frame_sink)
+                native_frame_sink(native_frame, native_frame_len);
+
+        SREG = _sreg_prev;
+        ws2812_wait_rst();
+        sei();
+
+        ws2812_seq++;
+#ifdef WS2812_DITHER
+        ws2812_dither_end();
+#endif
+}
+
+/* native_tx_byte
+ * --------------
+ * Description:
+ *      Appends a byte to the currently captured frame.
+ *      Bytes exceeding NATIVE_FRAME_MAX_BYTES are counted
+ *      but not stored.
+ */
+static void native_tx_byte(uint8_t data)
+{
+#ifdef WS2812_CAPTURE
+        if (WS2812_CAPTURING) {
+                ws2812_capture_tx(&data, 1);
+                if (!ws2812_capture_tee)
+                        return;
+        }
+#endif
+
+        native_bytes_tx++;
+
+        if (native_frame_len < NATIVE_FRAME_MAX_BYTES)
+                native_frame[native_frame_len++] = ws2812_correct(data);
+}
+
+/* ws2812_tx_buffer
+ * ----------------
+ * Description:
+ *      Appends a buffer to the currently captured frame.
+ */
+void ws2812_tx_buffer(const uint8_t *buf, uint16_t len)
+{
+        while (len--)
+                native_tx_byte(*buf++);
+}
+
+/* ws2812_tx_repeat
+ * ----------------
+ * Description:
+ *      Appends a buffer n times to the currently captured frame.
+ */
+void ws2812_tx_repeat(const uint8_t *buf, uint8_t len, uint16_t n)
+{
+        while (n--)
+                ws2812_tx_buffer(buf, len);
+}
+
+#endif
+
+#endif
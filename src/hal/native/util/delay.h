@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Native stand-in for avr-libc's <util/delay.h>.
+ *              Delays advance the simulated clock instead of
+ *              busy-waiting.
+ *
+ */
+
+#pragma once
+
+#include "../native.h"
+
+static inline void _delay_ms(double ms)
+{
+        native_advance_us((unsigned long)(ms * 1000));
+}
+
+static inline void _delay_us(double us)
+{
+        native_advance_us((unsigned long)us);
+}
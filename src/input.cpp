@@ -20,9 +20,64 @@
 
 #include "config.h"
 #include "input.h"
+#include "timer.h"
 
 // Analog To Digital Converter
 
+// The potentiometer and CV input are sampled in the background (see adc_sampler_start())
+#if !defined(ARDUINO_BUILD) && (!defined(BRIGHTNESS_POT_MISSING) || defined(CV_INPUT_ADMUX_MSK))
+#define ADC_SAMPLER
+#endif
+
+#ifdef ADC_SAMPLER
+
+#ifndef ADC_FILTER_SHIFT
+#define ADC_FILTER_SHIFT 4
+#endif
+
+#if ADC_FILTER_SHIFT > 8
+#error "ADC_FILTER_SHIFT must not exceed 8"
+#endif
+
+// Conversions are triggered by the millisecond tick. On addressable strips,
+// the compare match of Timer0 auto triggers them. On non-addressable strips,
+// Timer0 generates PWM, overflowing every 16 us, and the tick runs off
+// Timer1, which can't auto trigger the ADC. Its overflow ISR starts the
+// conversions by hand instead (see timer.cpp).
+#if STRIP_TYPE == WS2812
+#define ADC_TRIGGER ((1 << ADTS1) | (1 << ADTS0))     // Timer0 compare match A
+#define ADC_AUTO_TRIGGER (1 << ADATE)
+#else
+#define ADC_TRIGGER 0                                 // Unused, auto triggering stays disabled
+#define ADC_AUTO_TRIGGER 0
+#endif
+
+enum adc_channel {
+#ifndef BRIGHTNESS_POT_MISSING
+        ADC_POT,
+#endif
+#ifdef CV_INPUT_ADMUX_MSK
+        ADC_CV,
+#endif
+        ADC_CHANNELS
+};
+
+static const uint8_t adc_muxes[ADC_CHANNELS] = {
+#ifndef BRIGHTNESS_POT_MISSING
+        BRIGHTNESS_POT_ADMUX_MSK,
+#endif
+#ifdef CV_INPUT_ADMUX_MSK
+        CV_INPUT_ADMUX_MSK,
+#endif
+};
+
+static volatile uint8_t adc_channel = 0;                // Channel of the running conversion
+static volatile uint8_t adc_values[ADC_CHANNELS];       // Filtered reading of every channel
+static uint16_t adc_acc[ADC_CHANNELS];                  // Filter state, adc_values << ADC_FILTER_SHIFT
+static bool adc_sampling = false;
+
+#endif
+
 /* adc_clear_mux_bits
  * ------------------
  * Description:
@@ -34,6 +89,60 @@ void adc_clear_mux_bits()
         ADMUX &= ~(1 << MUX0| 1 << MUX1 | 1 << MUX2 | 1 << MUX3);
 }
 
+#ifdef ADC_SAMPLER
+
+/* ISR(ADC_vect)
+ * -------------
+ * Description:
+ *      Feeds a completed conversion into the exponential moving
+ *      average of its channel, which spans ~2^ADC_FILTER_SHIFT
+ *      samples, and selects the next channel for the next trigger.
+ *      The average settles exactly on constant inputs.
+ */
+ISR(ADC_vect)
+{
+        uint8_t ch = adc_channel;
+
+        adc_acc[ch] += ADCH - (adc_acc[ch] >> ADC_FILTER_SHIFT);
+        adc_values[ch] = adc_acc[ch] >> ADC_FILTER_SHIFT;
+
+        if (++ch >= ADC_CHANNELS)
+                ch = 0;
+
+        adc_channel = ch;
+        adc_clear_mux_bits();
+        ADMUX |= adc_muxes[ch];
+}
+
+/* adc_sampler_run
+ * ---------------
+ * Description:
+ *      Resumes sampling at the current channel. Discards any
+ *      pending conversion result, which may stem from a
+ *      blocking conversion of another channel.
+ */
+static void adc_sampler_run()
+{
+        adc_clear_mux_bits();
+        ADMUX |= adc_muxes[adc_channel];
+        ADCSRA |= (1 << ADIF) | ADC_AUTO_TRIGGER | (1 << ADIE); // Writing ADIF clears it
+        adc_sampling = true;
+}
+
+/* adc_sampler_stop
+ * ----------------
+ * Description:
+ *      Pauses sampling, leaving the ADC to blocking conversions.
+ */
+static void adc_sampler_stop()
+{
+        ADCSRA &= ~(ADC_AUTO_TRIGGER | (1 << ADIE));
+        loop_until_bit_is_clear(ADCSRA, ADSC);  // Let a triggered conversion complete
+        adc_sampling = false;
+}
+
+#endif
+
 /* adc_avg
  * -------
  * Parameters:
@@ -42,7 +151,8 @@ void adc_clear_mux_bits()
  * Returns:
  *      Average 8-bit ADC reading
  * Description:
- *      Returns the average ADC reading from n samples
+ *      Returns the average ADC reading from n samples. The
+ *      background sampler is paused in the meantime.
  */
 
 uint8_t adc_avg(uint8_t adc, uint8_t samples)
@@ -53,6 +163,13 @@ uint8_t adc_avg(uint8_t adc, uint8_t samples)
         for (uint8_t i = 0; i < samples; i++)
                 ret += analogRead(adc) >> 2;
 #else
+
+#ifdef ADC_SAMPLER
+        bool sampling = adc_sampling;
+        if (sampling)
+                adc_sampler_stop();
+#endif
+
         adc_clear_mux_bits();
         ADMUX |= adc;
 
@@ -62,9 +179,43 @@ uint8_t adc_avg(uint8_t adc, uint8_t samples)
                 ret += ADCH;
         }
 
+#ifdef ADC_SAMPLER
+        if (sampling)
+                adc_sampler_run();
 #endif
 
-        return round((double)ret/samples);
+#endif
+
+        return (ret + samples / 2) / samples;
+}
+
+/* adc_sampler_start
+ * -----------------
+ * Description:
+ *      Starts sampling the potentiometer and CV input in the
+ *      background, one conversion per millisecond tick (of Timer0,
+ *      or Timer1 on non-addressable strips), alternating between
+ *      the inputs. Reading either input thereby
+ *      neither waits for a conversion, nor blocks the render loop.
+ *      The filters are seeded with a blocking conversion each,
+ *      meaning the first frame already sees the inputs' value.
+ *      Must be called once the ADC and timers are initialized.
+ *      Does nothing if neither input is configured, or on Arduino
+ *      builds, which read the inputs on demand.
+ */
+void adc_sampler_start()
+{
+#ifdef ADC_SAMPLER
+        loop_until_bit_is_clear(ADCSRA, ADSC);  // Complete the initial conversion
+
+        for (uint8_t ch = 0; ch < ADC_CHANNELS; ch++) {
+                adc_values[ch] = adc_avg(adc_muxes[ch], 1);
+                adc_acc[ch] = adc_values[ch] << ADC_FILTER_SHIFT;
+        }
+
+        ADCSRB |= ADC_TRIGGER;
+        adc_sampler_run();
+#endif
 }
 
 // Potentiometer
@@ -74,11 +225,11 @@ uint8_t adc_avg(uint8_t adc, uint8_t samples)
  * Returns:
  *      The currently set potentiometer value
  * Description:
- *      Reads the current potentiometer value. Depending on the flags
- *      configured in config, this function may be as simple as
- *      simply returning the the current analog value of the pot
- *      input, or as complex as to calculate the average pot
- *      value.
+ *      Reads the current potentiometer value. On AVR builds, this
+ *      is the latest filtered reading of the background sampler
+ *      (see adc_sampler_start()), and thus doesn't wait for the ADC.
+ *      On Arduino builds, the pot input is converted on demand,
+ *      averaging ADC_AVG_SAMPLES readings if configured.
  */
 
 uint8_t pot()
@@ -86,20 +237,12 @@ uint8_t pot()
 #ifndef BRIGHTNESS_POT_MISSING
         uint8_t ret;
 
-#if defined(ADC_AVG_SAMPLES) && ADC_AVG_SAMPLES > 1
+#ifdef ADC_SAMPLER
+        ret = adc_values[ADC_POT];
+#elif defined(ADC_AVG_SAMPLES) && ADC_AVG_SAMPLES > 1
         ret = adc_avg(BRIGHTNESS_POT_ADMUX_MSK, ADC_AVG_SAMPLES);
 #else
-
-#ifdef ARDUINO_BUILD
         ret = analogRead(BRIGHTNESS_POT) >> 2;
-#else
-        adc_clear_mux_bits();
-        ADMUX |= BRIGHTNESS_POT_ADMUX_MSK;
-        ADCSRA |= (1 << ADSC); // Trigger ADC
-        loop_until_bit_is_clear(ADCSRA, ADSC);
-        ret = ADCH;
-#endif
-
 #endif
 
 #ifdef INVERT_POT
@@ -131,13 +274,17 @@ uint8_t pot()
  *      configuration defined but provided as a parameter.
  *      This is practical if average potentiometer readings
  *      are certainly required and are not simply an option.
+ *      On AVR builds, readings are always averaged by the
+ *      background sampler over ~2^ADC_FILTER_SHIFT samples,
+ *      and the sample size is ignored.
  */
 uint8_t pot_avg(uint8_t samples) {
 #ifndef BRIGHTNESS_POT_MISSING
 #ifdef ARDUINO_BUILD
         uint8_t ret = adc_avg(BRIGHTNESS_POT, samples);
 #else
-        uint8_t ret = adc_avg(BRIGHTNESS_POT_ADMUX_MSK, samples);
+        uint8_t ret = adc_values[ADC_POT];
+        (void)samples;
 #endif
 
 #ifdef INVERT_POT
@@ -166,11 +313,245 @@ uint8_t cv()
 #ifdef ARDUINO
         return analogRead(CV_INPUT) >> 2;
 #else
+        return adc_values[ADC_CV];
+#endif
+}
+#endif
+
+// Supply voltage
+
+// ADMUX mask of the internal 1.1 V bandgap reference
+#if defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
+#define VBG_ADMUX_MSK ((1 << MUX3) | (1 << MUX2) | (1 << MUX1))
+#else
+#define VBG_ADMUX_MSK ((1 << MUX3) | (1 << MUX2))
+#endif
+
+/* supply_ok()
+ * -----------
+ * Returns:
+ *      False if the supply voltage is below EEPROM_MIN_VCC_MV
+ * Description:
+ *      Measures the supply voltage by converting the 1.1 V bandgap
+ *      reference against the supply. As the supply drops, the
+ *      reading rises. The bandgap takes up to 1 ms to settle once
+ *      selected, which is waited out with the background sampler
+ *      paused. Always true if EEPROM_MIN_VCC_MV isn't set, or on
+ *      Arduino builds.
+ */
+bool supply_ok()
+{
+#if defined(EEPROM_MIN_VCC_MV) && EEPROM_MIN_VCC_MV > 0 && !defined(ARDUINO_BUILD)
+        uint8_t vbg;
+
+#ifdef ADC_SAMPLER
+        bool sampling = adc_sampling;
+        if (sampling)
+                adc_sampler_stop();
+#endif
+
         adc_clear_mux_bits();
-        ADMUX |= CV_INPUT_ADMUX_MSK;
-        ADCSRA |= (1 << ADSC); // Trigger ADC
-        loop_until_bit_is_clear(ADCSRA, ADSC);
-        return ADCH;
+        ADMUX |= VBG_ADMUX_MSK;
+        DELAY_MS(1);                    // Let the bandgap settle
+
+        vbg = adc_avg(VBG_ADMUX_MSK, 4);
+
+#ifdef ADC_SAMPLER
+        if (sampling)
+                adc_sampler_run();
+#endif
+
+        return vbg <= (1100UL * 256) / EEPROM_MIN_VCC_MV;
+#else
+        return true;
+#endif
+}
+
+// Push button
+
+#ifndef BTN_DEBOUNCE_TIME
+#define BTN_DEBOUNCE_TIME 0
+#endif
+
+#ifndef BTN_LONG_PRESS_MS
+#define BTN_LONG_PRESS_MS 1000
+#endif
+
+#ifndef BTN_HOLD_REPEAT_MS
+#define BTN_HOLD_REPEAT_MS 500
+#endif
+
+#ifndef BTN_DOUBLE_CLICK_MS
+#define BTN_DOUBLE_CLICK_MS 300
 #endif
+
+#define BTN_QUEUE_SIZE 4                        // Must be a power of two
+
+// The state below is shared with the pin change interrupt,
+// and hence only accessed with interrupts disabled
+static bool btn_level = false;                  // Debounced button state, true if pressed
+static unsigned long btn_edge = 0;              // millis() at the last debounced edge
+
+static uint8_t btn_queue[BTN_QUEUE_SIZE];
+static uint8_t btn_queue_head = 0;              // Next event to be pushed
+static uint8_t btn_queue_tail = 0;              // Next event to be popped
+
+static bool btn_long = false;                   // The current press has become a long press
+static bool btn_clicked = false;                // The last gesture was a single click
+static bool btn_double = false;                 // The current press follows a click within BTN_DOUBLE_CLICK_MS
+static tmr_t btn_press_tmr;
+static tmr_t btn_click_tmr;
+static tmr_t btn_hold_tmr;
+
+/* btn_push
+ * --------
+ * Parameters:
+ *      event - Button event
+ * Description:
+ *      Appends an event to the queue. Events are dropped
+ *      while the queue is full.
+ */
+static void btn_push(uint8_t event)
+{
+        uint8_t next = (btn_queue_head + 1) & (BTN_QUEUE_SIZE - 1);
+
+        if (next == btn_queue_tail)
+                return;
+
+        btn_queue[btn_queue_head] = event;
+        btn_queue_head = next;
+}
+
+/* btn_debounce
+ * ------------
+ * Returns:
+ *      True if the debounced state changed
+ * Description:
+ *      Takes over the state of the button pin as the debounced
+ *      state, unless the last debounced edge lies less than
+ *      BTN_DEBOUNCE_TIME back, during which the contacts may
+ *      still bounce. Edges are thereby registered without delay,
+ *      and their bounces ignored.
+ */
+static bool btn_debounce()
+{
+        bool state = BTN_STATE;
+        unsigned long now = millis();
+
+        if (state == btn_level || now - btn_edge < BTN_DEBOUNCE_TIME)
+                return false;
+
+        btn_level = state;
+        btn_edge = now;
+
+        return true;
+}
+
+/* btn_update
+ * ----------
+ * Description:
+ *      Debounces the button and advances the gesture state
+ *      machine on debounced presses and releases, queuing
+ *      clicks and double clicks on release. Must be called
+ *      with interrupts disabled.
+ */
+static void btn_update()
+{
+        if (!btn_debounce())
+                return;
+
+        if (btn_level) { // Press
+                btn_long = false;
+                btn_double = btn_clicked && !tmr_expired(&btn_click_tmr, BTN_DOUBLE_CLICK_MS);
+                tmr_reset(&btn_press_tmr);
+        } else if (!btn_long) { // Release
+                btn_push(btn_double ? BTN_DOUBLE_CLICK : BTN_CLICK);
+                btn_clicked = !btn_double; // A third click starts over
+                tmr_reset(&btn_click_tmr);
+        }
+}
+
+#ifndef ARDUINO_BUILD
+
+/* ISR(PCINT0_vect)
+ * ----------------
+ * Description:
+ *      Handles button edges as they occur, queuing clicks
+ *      and double clicks regardless of how often events
+ *      are polled. Also wakes the MCU from idle.
+ */
+ISR(PCINT0_vect)
+{
+        btn_update();
+}
+
+#endif
+
+/* button_event
+ * ------------
+ * Returns:
+ *      The oldest queued button event, BTN_NONE if none is queued
+ * Description:
+ *      Never blocks. Events are queued as follows:
+ *              BTN_CLICK - Released before BTN_LONG_PRESS_MS
+ *              BTN_DOUBLE_CLICK - Second click, pressed within BTN_DOUBLE_CLICK_MS
+ *                                 of the first, queued in place of its BTN_CLICK
+ *              BTN_LONG_PRESS - Held for BTN_LONG_PRESS_MS. Its release queues nothing.
+ *              BTN_HOLD - Still held, every BTN_HOLD_REPEAT_MS after BTN_LONG_PRESS
+ *      Clicks are queued by the pin change interrupt on release,
+ *      without waiting for a possible double click. Only the timeouts
+ *      of long presses and holds are queued here, along with edges
+ *      the interrupt ignored as the button settled during the
+ *      debounce time (or all edges on Arduino builds).
+ */
+uint8_t button_event()
+{
+        uint8_t event = BTN_NONE;
+        uint8_t sreg = SREG;
+        cli();
+
+        btn_update();
+
+        if (btn_level) { // Held
+                if (!btn_long) {
+                        if (tmr_expired(&btn_press_tmr, BTN_LONG_PRESS_MS)) {
+                                btn_long = true;
+                                btn_clicked = false;
+                                btn_push(BTN_LONG_PRESS);
+                                tmr_reset(&btn_hold_tmr);
+                        }
+                } else if (tmr_expired(&btn_hold_tmr, BTN_HOLD_REPEAT_MS)) {
+                        btn_push(BTN_HOLD);
+                        tmr_reset(&btn_hold_tmr);
+                }
+        }
+
+        if (btn_queue_tail != btn_queue_head) {
+                event = btn_queue[btn_queue_tail];
+                btn_queue_tail = (btn_queue_tail + 1) & (BTN_QUEUE_SIZE - 1);
+        }
+
+        SREG = sreg;
+
+        return event;
+}
+
+/* button_held
+ * -----------
+ * Returns:
+ *      Milliseconds the button has been held down for,
+ *      0 if it is released
+ */
+unsigned long button_held()
+{
+        unsigned long held = 0;
+        uint8_t sreg = SREG;
+        cli();
+
+        if (btn_level)
+                held = tmr_elapsed(&btn_press_tmr);
+
+        SREG = sreg;
+
+        return held;
 }
-#endif
\ No newline at end of file
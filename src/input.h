@@ -39,7 +39,24 @@
 #define BTN_STATE !(PINB & (1 << BTN))
 #endif
 
+/* btn_event
+ * ---------
+ * Description:
+ *      Gestures of the push button, as returned by button_event().
+ */
+enum btn_event {
+        BTN_NONE,               // No event queued
+        BTN_CLICK,              // Pressed and released
+        BTN_DOUBLE_CLICK,       // Clicked twice in quick succession
+        BTN_LONG_PRESS,         // Held down for BTN_LONG_PRESS_MS
+        BTN_HOLD                // Still held down after a long press, repeated every BTN_HOLD_REPEAT_MS
+};
+
 uint8_t adc_avg(uint8_t adc, uint8_t samples);
+void adc_sampler_start();
 uint8_t pot();
 uint8_t pot_avg(uint8_t samples);
 uint8_t cv();
+bool supply_ok();
+uint8_t button_event();
+unsigned long button_held();
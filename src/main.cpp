@@ -26,17 +26,24 @@
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <avr/eeprom.h>
+#include <avr/sleep.h>
 #include <util/delay.h>
 
 #ifdef ARDUINO_BUILD
 #include <Arduino.h>
 #endif
 
+#ifdef NATIVE_BUILD
+#include <stdio.h>
+#include "hal/native/native.h"
+#endif
+
 #include "config.h"
 #include "input.h"
 #include "strip.h"
-#include "time.h"
+#include "effect.h"
+#include "settings.h"
+#include "timer.h"
 
 ////////////////////////
 // Preprocessors
@@ -48,35 +55,20 @@
 
 #define MAX_BRIGHTNESS 255
 
-#ifndef PATCH_0
-#define PATCH_0 break
-#endif
-#ifndef PATCH_1
-#define PATCH_1 break
-#endif
-#ifndef PATCH_2
-#define PATCH_2 break
-#endif
-#ifndef PATCH_3
-#define PATCH_3 break
-#endif
-#ifndef PATCH_4
-#define PATCH_4 break
-#endif
-#ifndef PATCH_5
-#define PATCH_5 break
-#endif
-#ifndef PATCH_6
-#define PATCH_6 break
+#ifndef FRAME_TIME_MS
+#define FRAME_TIME_MS 1
 #endif
-#ifndef PATCH_7
-#define PATCH_7 break
-#endif
-#ifndef PATCH_8
-#define PATCH_8 break
+
+#ifndef BOOT_COMMIT_MS
+#define BOOT_COMMIT_MS 2000
 #endif
-#ifndef PATCH_9
-#define PATCH_9 break
+
+// Writing a one to a PINx bit toggles the pin, marking the
+// end of a boot stage with an edge on BOOT_TRACE_PIN
+#ifdef BOOT_TRACE_PIN
+#define BOOT_MARK() (PINB = (1 << BOOT_TRACE_PIN))
+#else
+#define BOOT_MARK()
 #endif
 
 ////////////////////////
@@ -87,76 +79,115 @@
 
 uint8_t selected_patch;
 
+// Boot
+
+static uint8_t boot_patch;              // Patch selected at power-up
+static bool boot_committed;             // Whether boot_patch has been saved
+static tmr_t boot_tmr;
+
 ////////////////////////
 // Functions
 ////////////////////////
 
-// LED Strip
+// Power
 
-/* update_strip
- * ----------
+/* idle
+ * ----
  * Description:
- *      Updates the strip for the provided patch.
- *      For animations, this function must be called
- *      repeatedly.
+ *      Puts the MCU into idle sleep until the next interrupt.
+ *      This is, at the latest, the next millisecond tick of
+ *      Timer0 (Timer1 on non-addressable strips), or a button
+ *      edge.
  */
-void update_strip(uint8_t patch)
+void idle()
 {
-        switch (patch) {
-                case 0 : {
-                        PATCH_0;
-                        break;
-                }
-                case 1 : {
-                        PATCH_1;
-                        break;
-                }
-                case 2 : {
-                        PATCH_2;
-                        break;
-                }
-                case 3 : {
-                        PATCH_3;
-                        break;
-                }
-                case 4 : {
-                        PATCH_4;
-                        break;
-                }
-                case 5 : {
-                        PATCH_5;
-                        break;
-                }
-                case 6 : {
-                        PATCH_6;
-                        break;
-                }
-                case 7 : {
-                        PATCH_7;
-                        break;
-                }
-                case 8 : {
-                        PATCH_8;
-                        break;
-                }
-                case 9 : {
-                        PATCH_9;
-                        break;
-                }
-                default: {
-                        break;
-                }
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_mode();
+}
+
+/* power_down_peripherals
+ * ----------------------
+ * Description:
+ *      Powers down the peripherals unused by the firmware.
+ *      Not required for the first frame, and thus deferred
+ *      until after it on FAST_BOOT builds.
+ */
+void power_down_peripherals()
+{
+#if !defined(ARDUINO_BUILD) && !defined(__AVR_ATmega328__) && !defined(__AVR_ATmega328P__)
+        ACSR |= (1 << ACD);                   // Analog comparator
+        PRR |= (1 << PRUSI);                  // USI
+#if STRIP_TYPE == WS2812
+        PRR |= (1 << PRTIM1);                 // Timer 1 (only used on non-addressable strips)
+#endif
+#endif
+}
+
+// Boot
+
+/* boot_select
+ * -----------
+ * Returns:
+ *      Patch to be shown at power-up
+ * Description:
+ *      Tentatively selects the patch following the one of the
+ *      last completed boot. The selection is only committed by
+ *      boot_commit() once it has been running for BOOT_COMMIT_MS.
+ *      Power cycles cut short thereby neither write to the EEPROM,
+ *      nor skip a patch. Must be called after settings_load().
+ */
+uint8_t boot_select()
+{
+        boot_patch = eeprom_settings.patch + 1;
+
+        if (boot_patch >= NUM_PATCHES)
+                boot_patch = 0;
+
+        boot_committed = false;
+        tmr_reset(&boot_tmr);
+
+        return boot_patch;
+}
+
+/* boot_commit
+ * -----------
+ * Returns:
+ *      True once the patch selected at power-up has been saved
+ * Description:
+ *      Saves the patch selected by boot_select() once it has been
+ *      running for BOOT_COMMIT_MS. Writes aborted due to a low
+ *      supply are retried another BOOT_COMMIT_MS later. Polled
+ *      by the main loop.
+ */
+bool boot_commit()
+{
+        if (!boot_committed && tmr_expired(&boot_tmr, BOOT_COMMIT_MS)) {
+                eeprom_settings.patch = boot_patch;
+                boot_committed = settings_save();
+                tmr_reset(&boot_tmr);
+#ifdef BOOT_TRACE_PIN
+                if (boot_committed)
+                        BOOT_MARK();          // Boot committed
+#endif
         }
+
+        return boot_committed;
 }
 
 ////////////////////////
 // Main routine
 ////////////////////////
 
-uint8_t eeprom_patch EEMEM = 0;
-
 void _main() {
+        // The brown-out detector holds FAST_BOOT builds in reset
+        // until the supply is up (see attiny85_fastboot in platformio.ini)
+#ifndef FAST_BOOT
         DELAY_MS(10);                         // Allow supply voltage to calm down 
+        power_down_peripherals();
+#endif
+
+        settings_load();
+        BOOT_MARK();                          // Settings loaded
 
         // Calibration
 #if STRIP_TYPE == WS2812
@@ -164,57 +195,68 @@ void _main() {
         if (strip_size == 0)
                 strip_calibrate();
 #endif
-
-        selected_patch =  eeprom_read_byte(&eeprom_patch);
-
-        if (++selected_patch == 3)
-                selected_patch = 0;
-                
-        eeprom_update_byte(&eeprom_patch, selected_patch);
+        BOOT_MARK();                          // Strip size known
 
         // Patches
-        update_strip(selected_patch);
+        selected_patch = boot_select();
+        effect_select(selected_patch);
+        effect_render();
+        BOOT_MARK();                          // First frame
+#ifdef FAST_BOOT
+        power_down_peripherals();
+#endif
         
         // Main loop
 
-        bool prev_btn_state = BTN_STATE;
-        bool calibrated = false;
-
-        while(true) {
-                bool btn_state = BTN_STATE;
-
-                if (!prev_btn_state && btn_state) { // Button press
-#if defined(BTN_DEBOUNCE_TIME) && BTN_DEBOUNCE_TIME > 0
-                        DELAY_MS(BTN_DEBOUNCE_TIME);
+#if STRIP_TYPE == WS2812 && !defined(STRIP_SIZE)
+        bool calibrated = false;              // Calibrated during the current long press
 #endif
+        tmr_t frame_tmr;
+        tmr_reset(&frame_tmr);
 
-#if STRIP_TYPE == WS2812
-                        reset_timer();
+        while(true) {
+                uint8_t event;
+
+                // Input never blocks, patches keep rendering while the button is held
+                while ((event = button_event()) != BTN_NONE) {
+                        switch (event) {
+                        case BTN_CLICK:
+                        case BTN_DOUBLE_CLICK:
+#if STRIP_TYPE != WS2812 || defined(STRIP_SIZE)
+                        case BTN_LONG_PRESS:          // Nothing to calibrate
 #endif
-                }
-
+                                selected_patch = (selected_patch + 1) % NUM_PATCHES;
+                                effect_select(selected_patch);
+                                effect_render();
+                                break;
 #if STRIP_TYPE == WS2812 && !defined(STRIP_SIZE)
-                else if (btn_state) {
-                        if (ms_passed() >= 5000) {
-                                strip_calibrate();
-                                calibrated = true;
+                        case BTN_LONG_PRESS:
+                                calibrated = false;
+                                break;
+                        case BTN_HOLD:
+                                if (!calibrated && button_held() >= 5000) {
+                                        strip_calibrate();
+                                        calibrated = true;
+                                }
+                                break;
+#endif
                         }
-                        
-                        continue;
                 }
-#endif
 
-                else if (prev_btn_state && !btn_state) { // Button Released
-                        if (calibrated) {
-                                calibrated = false;
-                        } else {
-                                selected_patch = (selected_patch + 1) % NUM_PATCHES;
-                                update_strip(selected_patch);
-                        }
+                boot_commit();
+
+                // Fixed timestep
+                if (tmr_expired(&frame_tmr, FRAME_TIME_MS)) {
+                        tmr_advance(&frame_tmr, FRAME_TIME_MS);
+
+                        // Fell behind by more than a frame, don't try to catch up
+                        if (tmr_expired(&frame_tmr, FRAME_TIME_MS))
+                                tmr_reset(&frame_tmr);
+
+                        effect_render();
                 }
 
-                prev_btn_state = btn_state;
-                update_strip(selected_patch);
+                idle();
         }
 }
 
@@ -227,6 +269,9 @@ void setup() {
         Serial.begin(9600);
         pinMode(WS2812_DIN, OUTPUT);
         pinMode(BTN, INPUT_PULLUP);
+#ifdef BOOT_TRACE_PIN
+        DDRB |= (1 << BOOT_TRACE_PIN);
+#endif
 #ifndef BRIGHTNESS_POT_MISSING
         pinMode(BRIGHTNESS_POT, INPUT);
 #endif
@@ -236,6 +281,73 @@ void loop() {
         _main();
 }
 
+#elif defined(NATIVE_BUILD)
+
+// The benchmark and the unit tests provide their own entry point
+// (see bench/bench.cpp and test/)
+#if !defined(NATIVE_BENCH) && !defined(PIO_UNIT_TESTING)
+
+/* native_print_frame
+ * ------------------
+ * Description:
+ *      Prints a captured frame as a single line of hex
+ *      encoded bytes, in the order they were transmitted.
+ */
+void native_print_frame(const uint8_t *frame, uint16_t len)
+{
+        printf("%lu ", millis());
+        for (uint16_t i = 0; i < len; i++)
+                printf("%02x", frame[i]);
+        printf("\n");
+}
+
+/* main
+ * ----
+ * Usage:
+ *      firmware [patch] [ms] [strip size]
+ * Description:
+ *      Host entry point. Runs the selected patch (default 0) for
+ *      the provided amount of simulated milliseconds (default 1000),
+ *      calling effect_render() once per millisecond, and prints every
+ *      transmitted frame to stdout. The strip size defaults to the
+ *      configured size.
+ */
+int main(int argc, char *argv[])
+{
+        native_reset();
+
+        uint8_t patch = (argc > 1) ? atoi(argv[1]) : 0;
+        unsigned long ms = (argc > 2) ? strtoul(argv[2], NULL, 10) : 1000;
+
+#if STRIP_TYPE == WS2812
+        strip_size = (argc > 3) ? atoi(argv[3]) : GET_STRIP_SIZE;
+        if (strip_size == 0) {
+                fprintf(stderr, "Strip size must be provided for uncalibrated builds\n");
+                return 1;
+        }
+#endif
+
+        if (patch >= NUM_PATCHES) {
+                fprintf(stderr, "Patch must be between 0 and %d\n", NUM_PATCHES - 1);
+                return 1;
+        }
+
+        native_frame_sink = native_print_frame;
+
+        effect_select(patch);
+
+        for (unsigned long i = 0; i < ms; i++) {
+                effect_render();
+                native_advance_ms(1);
+        }
+
+        fprintf(stderr, "%lu frames, %lu bytes transmitted\n", native_frames_tx, native_bytes_tx);
+
+        return 0;
+}
+
+#endif
+
 #else
 
 /* main
@@ -247,16 +359,21 @@ int main()
 {
         // Initialization
 
-        // Timer 0
+#ifdef BOOT_TRACE_PIN
+        DDRB |= (1 << BOOT_TRACE_PIN);
+        BOOT_MARK();                          // Reset released
+#endif
 
-        TCCR0B |= (1 << CS00);                // No prescaling
+        // Timer 0
 
-#if defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
-        TIMSK0 |= (1 << TOIE0);                // Enable Timer interrupts
-        TIFR0 |= (1 << TOV0);                  // Interrupt on timer overflow
+#if STRIP_TYPE == WS2812
+        TCCR0B |= (1 << CS01) | (1 << CS00);  // Prescaler 64
+        TCCR0A |= (1 << WGM01);               // CTC mode
+        OCR0A = TMR_CTC_TOP;                  // Compare match every ms
+        TMR_TIFR = (1 << OCF0A);              // Clear pending compare match
+        TMR_TIMSK |= (1 << OCIE0A);           // Interrupt on compare match
 #else
-        TIMSK |= (1 << TOIE0);                // Enable Timer interrupts
-        TIFR |= (1 << TOV0);                  // Interrupt on timer overflow
+        TCCR0B |= (1 << CS00);                // No prescaling (62.5 kHz PWM)
 #endif
 
 #if STRIP_TYPE == NON_ADDR
@@ -274,11 +391,11 @@ int main()
         OCR0B = 0;
 
         // Timer 1
+        // Provides the millisecond tick, Timer0 being busy with PWM.
+        // The PWM on PB4 thereby runs at 1 kHz, with a duty cycle of
+        // OCR1B / (TMR_CTC_TOP + 1), saturating above TMR_CTC_TOP.
 
-	PLLCSR |= (1 << PLLE); // Enable PLL (64 MHz)
-	PLLCSR |= (1 << PCKE); // Use PLL as timer clock source
-
-        TCCR1 |= (1 << CS10); // 1024 Prescaler
+        TCCR1 |= (1 << CS12) | (1 << CS11) | (1 << CS10); // Prescaler 64
 
         GTCCR |= (1 << PWM1B)
               |  (1 << COM1B1) | (0 << COM1B0); // Non-Inverting PWM on OCR1B/PB4
@@ -286,7 +403,9 @@ int main()
         TCCR1 |= (1 << COM1A0);
 
         OCR1B = 0;
-        OCR1C = 255;
+        OCR1C = TMR_CTC_TOP;                  // Overflow every ms
+        TMR_TIFR = (1 << TOV1);               // Clear pending overflow
+        TMR_TIMSK |= (1 << TOIE1);            // Interrupt on timer overflow
 #endif
 
         // Pins
@@ -297,6 +416,14 @@ int main()
         DDRB &= ~(1 << BTN);                  // Set button pin to input
         PORTB |= (1 << BTN);                  // Enable internal pull-up on Button pin
 
+#if defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
+        PCMSK0 |= (1 << BTN);                 // Pin change interrupt on button pin
+        PCICR |= (1 << PCIE0);
+#else
+        PCMSK |= (1 << BTN);                  // Pin change interrupt on button pin
+        GIMSK |= (1 << PCIE);
+#endif
+
         // ADC
         ADMUX = (1 << ADLAR); // Reduce ADC input to 8-bit value (0-255)
 
@@ -315,7 +442,10 @@ int main()
                 (1 << ADPS1) |                // set prescaler to 128, bit 1 
                 (1 << ADPS0);                 // set prescaler to 128, bit 0
 
+        adc_sampler_start();                  // Sample the pot and CV input in the background
+
         sei();
+        BOOT_MARK();                          // Peripherals initialized
 
         _main();
 }
@@ -22,11 +22,18 @@
 #pragma once
 
 #include "config.h"
+#include "color.h"
 #include "strip.h"
-#include "time.h"
+#include "timer.h"
 
 #define RGB_ARRAY(...) __VA_ARGS__ 
 
+// Patch macros are expanded within the render function of a patch (see
+// effect.cpp), where patch_state points to the state block of the patch.
+// The type of the state block is set by the second argument of the PATCH()
+// entry in config.h, and must match the "State" listed for the macro.
+// Macros without a listed state require none.
+
 //////////////////////////////////
 // Static
 //////////////////////////////////
@@ -43,23 +50,16 @@
  */
 #define PATCH_SET_ALL(R, G, B) \
         RGB_t rgb = {R, G, B}; \
-        rgb_apply_brightness(rgb, pot()); \
+        nscale8x3(rgb, pot()); \
         strip_apply_all(rgb);
 
 #define PATCH_SPLIT(R1, G1, B1, R2, G2, B2, SPLIT) \
-        static substrpbuf buf = {2, NULL}; \
-        if (!buf.substrps) \
-                buf.substrps = (substrp *)malloc(sizeof(substrp) * 2); \
-        buf.substrps[0].length = SPLIT; \
-        buf.substrps[0].rgb[R] = R1; \
-        buf.substrps[0].rgb[G] = G1; \
-        buf.substrps[0].rgb[B] = B1; \
-        buf.substrps[1].length = strip_size - SPLIT; \
-        buf.substrps[1].rgb[R] = R2; \
-        buf.substrps[1].rgb[G] = G2; \
-        buf.substrps[1].rgb[B] = B2; \
-        substripbuf_apply_brightness(&buf, pot()); \
-        strip_apply_substrpbuf(buf);
+        RGB_t first = {R1, G1, B1}; \
+        RGB_t second = {R2, G2, B2}; \
+        rlebuf buf; \
+        rlebuf_split(&buf, first, second, SPLIT); \
+        rlebuf_apply_brightness(&buf, pot()); \
+        strip_apply_rlebuf(&buf);
 
 /* PATCH_DISTRIBUTE
  * ----------------
@@ -68,16 +68,40 @@
  *                Ex. RGB_ARRAY({255, 255, 255}, {0, 1, 2}, ...)
  * Description:
  *      Distributes the provided array of RGB values evenly across the entire LED strip.
+ *      Takes up to RLEBUF_RUNS colors, more fail to compile.
  */
 #define PATCH_DISTRIBUTE(RGB_ARR) \
         RGB_t rgb[] = { \
                 RGB_ARR \
         }; \
+        static_assert(sizeof(rgb)/sizeof(RGB_t) <= RLEBUF_RUNS, \
+                      "PATCH_DISTRIBUTE takes at most RLEBUF_RUNS colors (see config.h)"); \
         uint8_t brightness = pot(); \
         for (uint16_t i = 0; i < sizeof(rgb)/sizeof(RGB_t); i++) \
-                rgb_apply_brightness(rgb[i], brightness); \
+                nscale8x3(rgb[i], brightness); \
         strip_distribute_rgb(rgb, sizeof(rgb)/sizeof(RGB_t));
 
+/* PATCH_GRADIENT
+ * --------------
+ * Parameters:
+ *      RGB_ARR - An RGB_ARRAY() enclosed array of literal RGB arrays.
+ *                Ex. RGB_ARRAY({255, 0, 0}, {0, 0, 255}, ...)
+ * Description:
+ *      Fades evenly between the provided array of RGB values, from the first
+ *      to the last pixel of the LED strip. Takes up to RLEBUF_RUNS colors,
+ *      more fail to compile.
+ */
+#define PATCH_GRADIENT(RGB_ARR) \
+        RGB_t rgb[] = { \
+                RGB_ARR \
+        }; \
+        static_assert(sizeof(rgb)/sizeof(RGB_t) <= RLEBUF_RUNS, \
+                      "PATCH_GRADIENT takes at most RLEBUF_RUNS colors (see config.h)"); \
+        uint8_t brightness = pot(); \
+        for (uint16_t i = 0; i < sizeof(rgb)/sizeof(RGB_t); i++) \
+                nscale8x3(rgb[i], brightness); \
+        strip_gradient_rgb(rgb, sizeof(rgb)/sizeof(RGB_t));
+
 /* PATCH_DIAL_RGB
  * --------------
  * Parameters:
@@ -85,7 +109,7 @@
  * Description:
  *      Dials a color within RGB spectrum with the potentiometer
  */
-#define PATCH_DIAL_RGB(BRIGHTNESS) strip_scroll_rgb(pot() * 3, BRIGHTNESS)
+#define PATCH_DIAL_RGB(BRIGHTNESS) strip_scroll_rgb(pot() << 8, BRIGHTNESS)
 
 
 /* --------------------------------
@@ -98,7 +122,7 @@
                 rgb[R] = R_HI; \
                 rgb[G] = G_HI; \
                 rgb[B] = B_HI; \
-                rgb_apply_brightness(rgb, pot()); \
+                nscale8x3(rgb, pot()); \
         } else { \
                 rgb[R] = R_LO; \
                 rgb[G] = G_LO; \
@@ -106,25 +130,24 @@
         } \
         strip_apply_all(rgb);
 
+// State: swap
 #define PATCH_SET_ALL_TOGGLE_ON_RISE(R1, G1, B1, R2, G2, B2, TRIGGER) \
-        static bool prev_trigger = false; \
-        static bool toggle = false; \
         RGB_t rgb; \
         bool trigger = (cv() >= TRIGGER); \
-        if (!prev_trigger && trigger) \
-                toggle = !toggle; \
-        if (toggle) { \
+        if (!patch_state->prev_trigger && trigger) \
+                patch_state->swap = !patch_state->swap; \
+        if (patch_state->swap) { \
                 rgb[R] = R1; \
                 rgb[G] = G1; \
                 rgb[B] = B1; \
-                rgb_apply_brightness(rgb, pot()); \
+                nscale8x3(rgb, pot()); \
         } else { \
                 rgb[R] = R2; \
                 rgb[G] = G2; \
                 rgb[B] = B2; \
         } \
         strip_apply_all(rgb); \
-        prev_trigger = trigger;
+        patch_state->prev_trigger = trigger;
 
 //////////////////////////////////
 // Animations
@@ -139,21 +162,25 @@
  * Parameters:
  *      STEP_SIZE - Color steps (0 - 255) between each call.
  *                  A greater value results in faster fading.
+ * State:
+ *      rainbow
  * Description:
  *      Gradiently fades all LEDs simultaneously trough the RGB spectrum.
  *      Supported on non-addressable strips.
  */
-#define PATCH_ANIMATION_RAINBOW(STEP_SIZE, DELAY, BRIGHTNESS) strip_rainbow(STEP_SIZE, DELAY, BRIGHTNESS)
+#define PATCH_ANIMATION_RAINBOW(STEP_SIZE, DELAY, BRIGHTNESS) strip_rainbow(patch_state, STEP_SIZE, DELAY, BRIGHTNESS)
 
 /* PATCH_ANIMATION_ROTATE_RAINBOW
  * ------------------------------
  *  * Parameters:
  *      STEP_SIZE - Color steps (0 - 255) between each pixel.
  *      DELAY - Delay between each call in ms
+ * State:
+ *      rainbow
  * Description:
  *      Rotates the rgb spectrum across the strip.
  */
-#define PATCH_ANIMATION_ROTATE_RAINBOW(STEP_SIZE, DELAY) strip_rotate_rainbow(STEP_SIZE, DELAY);
+#define PATCH_ANIMATION_ROTATE_RAINBOW(STEP_SIZE, DELAY) strip_rotate_rainbow(patch_state, STEP_SIZE, DELAY);
 
 /* PATCH_ANIMATION_SWAP
  * --------------------
@@ -165,20 +192,21 @@
  *      GFH - Green value (0 - 255) of second strip half
  *      BFH - Blue value (0 - 255) of second strip half
  *      SWAP_TIME - Time (ms) after which the halves get swapped
+ * State:
+ *      swap
  * Description:
  *      Splits the strip in two halves and continiously swaps their colors.
  *      Only supported on addressable strips.
  */
 #define PATCH_ANIMATION_SWAP(RFH, GFH, BFH, RSH, GSH, BSH, SWAP_TIME) \
-        static bool swap = false; \
-        if (ms_passed() >= SWAP_TIME) { \
-                if (swap) { \
+        if (tmr_expired(&patch_state->tmr, SWAP_TIME)) { \
+                if (patch_state->swap) { \
                         PATCH_DISTRIBUTE(RGB_ARRAY({RFH, GFH, BFH}, {RSH, GSH, BSH})); \
                 } else { \
                         PATCH_DISTRIBUTE(RGB_ARRAY({RSH, GSH, BSH}, {RFH, GFH, BFH})); \
                 } \
-                swap = !swap; \
-                reset_timer(); \
+                patch_state->swap = !patch_state->swap; \
+                tmr_reset(&patch_state->tmr); \
         }
 
 /* PATCH_ANIMATION_RAIN
@@ -191,10 +219,11 @@
  *      MIN_T_APPART - Minimum time in ms between drops
  *      MAX_T_APPART - Maximum time in ms between drops
  *      DELAY - Delay of droplet fading
+ * State:
+ *      rain
  * Description:
  *      Creates a rain effect across the strip.
- *      Note that this effect makes use of an RGB buffer and will linearly increase 
- *      memory consumption with strip size. 
+ *      The number of visible droplets is capped by DROPSET_SIZE (see config.h).
  *      Only supported on addressable strips.
  */
 #define PATCH_ANIMATION_RAIN(_R, _G, _B, MAX_DROPS, MIN_T_APPART, MAX_T_APPART, DELAY) \
@@ -202,27 +231,49 @@
         rgb[R] = _R; \
         rgb[G] = _G; \
         rgb[B] = _B; \
-        strip_rain(rgb, MAX_DROPS, MIN_T_APPART, MAX_T_APPART, DELAY);
+        strip_rain(patch_state, rgb, MAX_DROPS, MIN_T_APPART, MAX_T_APPART, DELAY);
+
+/* PATCH_ANIMATION_TWINKLE
+ * -----------------------
+ * Parameters:
+ *      _R - Red color value
+ *      _G - Green color value
+ *      _B - Blue color value
+ *      MIN_T_APPART - Minimum time in ms between twinkles
+ *      MAX_T_APPART - Maximum time in ms between twinkles
+ *      DELAY - Delay in ms between each fading step
+ * State:
+ *      twinkle
+ * Description:
+ *      Lights up random pixels, which then slowly fade out.
+ *      Pixels are held in a palette buffer (see strip.h), hence the
+ *      state costs half a byte per LED, for up to PALBUF_PIXELS LEDs.
+ *      Only supported on addressable strips.
+ */
+#define PATCH_ANIMATION_TWINKLE(_R, _G, _B, MIN_T_APPART, MAX_T_APPART, DELAY) \
+        RGB_t rgb; \
+        rgb[R] = _R; \
+        rgb[G] = _G; \
+        rgb[B] = _B; \
+        strip_twinkle(patch_state, rgb, MIN_T_APPART, MAX_T_APPART, DELAY);
 
+// State: override
 #define PATCH_ANIMATION_OVERRIDE_ARR(RGB_ARR, DELAY) \
         RGB_t rgb[] = { \
                 RGB_ARR \
         }; \
-        strip_override_array(rgb, sizeof(rgb)/sizeof(RGB_t), DELAY);
-
-#define PATCH_ANIMATION_OVERRIDE_RAND(DELAY) \
-        static RGB_t rgb = {255, 255, 255}; \
-        if (strip_override(rgb, DELAY)) { \
-                rgb[R] = rand() % 256; \
-                rgb[G] = rand() % 256; \
-                rgb[B] = rand() % 256; \
-        }
+        strip_override_array(patch_state, rgb, sizeof(rgb)/sizeof(RGB_t), DELAY);
 
-#define PATCH_ANIMATION_OVERRIDE_RAINBOW(DELAY, STEP_SIZE) strip_override_rainbow(DELAY, STEP_SIZE);
+// State: override
+#define PATCH_ANIMATION_OVERRIDE_RAND(DELAY) strip_override_random(patch_state, DELAY);
 
+// State: override_rainbow
+#define PATCH_ANIMATION_OVERRIDE_RAINBOW(DELAY, STEP_SIZE) strip_override_rainbow(patch_state, DELAY, STEP_SIZE);
+
+// State: fade
 #define PATCH_ANIMATION_FADE(R, G, B, DELAY_MS, STEP_SIZE) \
         RGB_t rgb = {R, G, B}; \
-        strip_fade(rgb, DELAY_MS, STEP_SIZE, false);
+        strip_fade(patch_state, rgb, DELAY_MS, STEP_SIZE, false);
 
 /* PATCH_ANIMATION_BREATHE
  * --------------------------------
@@ -232,27 +283,29 @@
  *      B - Blue value (0 - 255)
  *      DELAY_MS - Delay between each change in brightness
  *      STEP_SIZE - Brightness steps
-
+ * State:
+ *      breathe
  * Description:
  *      "Breathes" the provided RGB value across the entire strip.
  */
-#define PATCH_ANIMATION_BREATHE(R, G, B, STEP_SIZE) \
+#define PATCH_ANIMATION_BREATHE(R, G, B, DELAY_MS, STEP_SIZE) \
         RGB_t rgb = {R, G, B}; \
-        strip_breathe(rgb, DELAY_MS, STEP_SIZE)
+        strip_breathe(patch_state, rgb, DELAY_MS, STEP_SIZE);
 
 /* PATCH_ANIMATION_BREATHE_RAND
  * -------------------------------------
  * Parameters:
  *      STEP_SIZE - Brightness steps
  *      DELAY_MS - Delay between each change in brightness
- *
+ * State:
+ *      breathe
  * Description:
  *      "Breathes" random RGB values across the entire strip.
  *      Due to the rather poor randomness of rand(), the outcomes tend
  *      to be similar.
  *      Supported on non-addressable strips.
  */
-#define PATCH_ANIMATION_BREATHE_RAND(DELAY_MS, STEP_SIZE) strip_breathe_random(DELAY_MS, STEP_SIZE)
+#define PATCH_ANIMATION_BREATHE_RAND(DELAY_MS, STEP_SIZE) strip_breathe_random(patch_state, DELAY_MS, STEP_SIZE)
 
 /* PATCH_ANIMATION_BREATHE_RAINBOW
  * ----------------------------------------
@@ -262,11 +315,12 @@
  *                         A greater step size means the color difference 
  *                         between each breath becomes more noticeable. 
  *      DELAY_MS         - Delay between each change in brightness
- * 
+ * State:
+ *      breathe_rainbow
  * Description:
  *      Gradiently "Breathes" trough the rgb spectrum.
  */
-#define PATCH_ANIMATION_BREATHE_RAINBOW(DELAY_MS, BREATH_STEP_SIZE, RGB_STEP_SIZE) strip_breathe_rainbow(DELAY_MS, BREATH_STEP_SIZE, RGB_STEP_SIZE)
+#define PATCH_ANIMATION_BREATHE_RAINBOW(DELAY_MS, BREATH_STEP_SIZE, RGB_STEP_SIZE) strip_breathe_rainbow(patch_state, DELAY_MS, BREATH_STEP_SIZE, RGB_STEP_SIZE)
 
 /* PATCH_ANIMATION_BREATHE_ARR_POT_CTRL
  * ------------------------------------
@@ -275,7 +329,8 @@
  *                  Ex. RGB_ARRAY({255, 255, 255}, {0, 1, 2}, ...)
  *      DELAY_MS  - Delay between each change in brightness
  *      STEP_SIZE - Brightness steps
- * 
+ * State:
+ *      breathe
  * Description:
  *      Gradiently "Breathes" trough the RGB array.
  *      Supported on non-addressable strips.
@@ -284,7 +339,7 @@
         RGB_t rgb[] = { \
                 RGB_ARR \
         }; \
-        strip_breathe_array(rgb, sizeof(rgb)/sizeof(RGB_t), DELAY_MS, STEP_SIZE);
+        strip_breathe_array(patch_state, rgb, sizeof(rgb)/sizeof(RGB_t), DELAY_MS, STEP_SIZE);
 
 /* --------------------------------
  * Potentiometer Controllable
@@ -292,12 +347,14 @@
 
 /* PATCH_ANIMATION_RAINBOW_POT_CTRL
  * ---------------------------------
+ * State:
+ *      rainbow
  * Description:
  *      Gradiently fades all LEDs simultaneously trough the RGB spectrum.
  *      The step size, and thus speed, can be altered by the potentiometer.
  *      Supported on non-addressable strips.
  */
-#define PATCH_ANIMATION_RAINBOW_POT_CTRL strip_rainbow(pot() >> 6, (255 - pot()) >> 3, 255)
+#define PATCH_ANIMATION_RAINBOW_POT_CTRL strip_rainbow(patch_state, pot() >> 6, (255 - pot()) >> 3, 255)
 
 /* PATCH_ANIMATION_SWAP_POT_CTRL
  * -----------------------------
@@ -308,15 +365,16 @@
  *      RFH - Red value (0 - 255) of second strip half
  *      GFH - Green value (0 - 255) of second strip half
  *      BFH - Blue value (0 - 255) of second strip half
+ * State:
+ *      swap
  * Description:
  *      Splits the strip in two halves and continiously swaps their colors.
  *      The swap time can be altered by the potentiometer.
  *      Only supported on addressable strips.
  */
 #define PATCH_ANIMATION_SWAP_POT_CTRL(RFH, GFH, BFH, RSH, GSH, BSH) \
-        static bool swap = false; \
-        if (ms_passed() >= (uint16_t)(1020 - (pot() << 2) + 100)) { \
-                if (swap) { \
+        if (tmr_expired(&patch_state->tmr, (uint16_t)(1020 - (pot() << 2) + 100))) { \
+                if (patch_state->swap) { \
                         RGB_t rgb[] = { \
                                 {RFH, GFH, BFH}, {RSH, GSH, BSH} \
                         }; \
@@ -327,8 +385,8 @@
                         }; \
                         strip_distribute_rgb(rgb, sizeof(rgb)/sizeof(RGB_t)); \
                 } \
-                swap = !swap; \
-                reset_timer(); \
+                patch_state->swap = !patch_state->swap; \
+                tmr_reset(&patch_state->tmr); \
         }
 
 /* PATCH_ANIMATION_ROTATE_RAINBOW
@@ -336,10 +394,12 @@
  *  * Parameters:
  *      STEP_SIZE - Color steps (0 - 255) between each pixel.
  *      DELAY - Delay between each call in ms
+ * State:
+ *      rainbow
  * Description:
  *      Rotates the rgb spectrum across the strip. The speed can be adjusted by the potentiometer.
  */
-#define PATCH_ANIMATION_ROTATE_RAINBOW_POT_CTRL(STEP_SIZE) strip_rotate_rainbow(STEP_SIZE, 50);
+#define PATCH_ANIMATION_ROTATE_RAINBOW_POT_CTRL(STEP_SIZE) strip_rotate_rainbow(patch_state, STEP_SIZE, 50);
 
 /* PATCH_ANIMATION_RAIN_POT_CTRL
  * -----------------------------
@@ -347,11 +407,12 @@
  *      _R - Red color value
  *      _G - Green color value
  *      _B - Blue color value
+ * State:
+ *      rain
  * Description:
  *      Creates a rain effect across the strip.
  *      The "intensity" of the rain can be adjusted with the potentiometer.
- *      Note that this effect makes use of an RGB buffer and will linearly increase 
- *      memory consumption with strip size.
+ *      The number of visible droplets is capped by DROPSET_SIZE (see config.h).
  *      Only supported on addressable strips.
  */
 #define PATCH_ANIMATION_RAIN_POT_CTRL(_R, _G, _B) \
@@ -363,35 +424,31 @@
         uint8_t delay = (31 - (pot_read >> 3)); \
         if (delay > 10) \
                 delay = 10; \
-        strip_rain(rgb, (pot_read * strip_size) / 255, 255 - pot_read + 5, 510 - (pot_read << 1) + 5, delay);
+        strip_rain(patch_state, rgb, (pot_read * strip_size) / 255, 255 - pot_read + 5, 510 - (pot_read << 1) + 5, delay);
 
+// State: override
 #define PATCH_ANIMATION_OVERRIDE_ARR_POT_CTRL(RGB_ARR) \
         RGB_t rgb[] = { \
                 RGB_ARR \
         }; \
-        strip_override_array(rgb, sizeof(rgb)/sizeof(RGB_t), 255 - pot() + 5);
-
-#define PATCH_ANIMATION_OVERRIDE_RAND_POT_CTRL \
-        static RGB_t rgb = {255, 255, 255}; \
-        if (strip_override(rgb, 255 - pot())) { \
-                rgb[R] = rand() % 256; \
-                rgb[G] = rand() % 256; \
-                rgb[B] = rand() % 256; \
-        }
+        strip_override_array(patch_state, rgb, sizeof(rgb)/sizeof(RGB_t), 255 - pot() + 5);
 
-#define PATCH_ANIMATION_OVERRIDE_RAINBOW_POT_CTRL(STEP_SIZE) strip_override_rainbow(255 - pot(), STEP_SIZE);
+// State: override
+#define PATCH_ANIMATION_OVERRIDE_RAND_POT_CTRL strip_override_random(patch_state, 255 - pot());
+
+// State: override_rainbow
+#define PATCH_ANIMATION_OVERRIDE_RAINBOW_POT_CTRL(STEP_SIZE) strip_override_rainbow(patch_state, 255 - pot(), STEP_SIZE);
 
 /* --------------------------------
  * CV Controllable
  * -------------------------------- */
 
+// State: swap
 #define PATCH_ANIMATION_SWAP_ON_RISE(RFH, GFH, BFH, RSH, GSH, BSH, TRIGGER) \
-        static bool prev_trigger = false; \
-        static bool swap = false; \
         bool trigger = (cv() >= TRIGGER); \
-        if (!prev_trigger && trigger) \
-                swap = !swap; \
-        if (swap) { \
+        if (!patch_state->prev_trigger && trigger) \
+                patch_state->swap = !patch_state->swap; \
+        if (patch_state->swap) { \
                 RGB_t rgb[] = { \
                         {RFH, GFH, BFH}, {RSH, GSH, BSH} \
                 }; \
@@ -402,14 +459,14 @@
                 }; \
                 strip_distribute_rgb(rgb, sizeof(rgb)/sizeof(RGB_t)); \
         } \
-        prev_trigger = trigger;
+        patch_state->prev_trigger = trigger;
 
+// State: move_div
 #define PATCH_ANIMATION_MOVE_DIV_ON_RISE(_R, _G, _B, DIV_SIZE, TRIGGER) \
-        static int remaining = strip_size - DIV_SIZE; \
-        static bool prev_trigger = false; \
-        static substrpbuf buf = {3, NULL}; \
-        if (!buf.substrps) { \
-                buf.substrps = (substrp *) malloc(sizeof(substrp) * 3); \
+        substrpbuf buf = {3, patch_state->substrps}; \
+        if (!patch_state->ready) { \
+                patch_state->ready = true; \
+                patch_state->remaining = strip_size - DIV_SIZE; \
                 buf.substrps[0].length = 0; \
                 buf.substrps[0].rgb[R] = 0; \
                 buf.substrps[0].rgb[G] = 0; \
@@ -418,38 +475,95 @@
                 buf.substrps[1].rgb[R] = _R; \
                 buf.substrps[1].rgb[G] = _G; \
                 buf.substrps[1].rgb[B] = _B; \
-                buf.substrps[2].length = (uint16_t) remaining; \
+                buf.substrps[2].length = (uint16_t) patch_state->remaining; \
                 buf.substrps[2].rgb[R] = 0; \
                 buf.substrps[2].rgb[G] = 0; \
                 buf.substrps[2].rgb[B] = 0; \
         } \
-        if (remaining <= -DIV_SIZE) { \
-                Serial.println(remaining); \
-                remaining = strip_size - DIV_SIZE; \
+        if (patch_state->remaining <= -DIV_SIZE) { \
+                patch_state->remaining = strip_size - DIV_SIZE; \
                 buf.substrps[0].length = 0; \
-                buf.substrps[2].length = (uint16_t) remaining; \
+                buf.substrps[2].length = (uint16_t) patch_state->remaining; \
         } \
         strip_apply_substrpbuf(buf); \
         bool trigger = (cv() >= TRIGGER); \
-        if (!prev_trigger && trigger) { \
+        if (!patch_state->prev_trigger && trigger) { \
                 buf.substrps[0].length += DIV_SIZE; \
-                remaining -= DIV_SIZE; \
-                buf.substrps[2].length = (remaining > 0) ? (uint16_t) remaining : 0; \
+                patch_state->remaining -= DIV_SIZE; \
+                buf.substrps[2].length = (patch_state->remaining > 0) ? (uint16_t) patch_state->remaining : 0; \
         } \
-        prev_trigger = trigger;
+        patch_state->prev_trigger = trigger;
 
+// State: trigger_fade
 #define PATCH_ANIMATION_FADE_ON_RISE(_R, _G, _B, DELAY_MS, TRIGGER) \
-        static bool prev_trigger = false; \
-        static bool fade = true; \
-        static RGB_t rgb = {_R, _G, _B}; \
+        RGB_t rgb = {_R, _G, _B}; \
         bool trigger = (cv() >= TRIGGER); \
         uint8_t steps = pot(); \
         if (!steps) \
                 steps = 1; \
-        if (!prev_trigger && trigger) { \
-                fade = strip_fade(rgb, 1, steps, true); \
-        } else if (!fade) { \
-                fade = strip_fade(rgb, 1, steps, false); \
+        if (!patch_state->prev_trigger && trigger) { \
+                patch_state->done = strip_fade(&patch_state->fade, rgb, 1, steps, true); \
+        } else if (!patch_state->done) { \
+                patch_state->done = strip_fade(&patch_state->fade, rgb, 1, steps, false); \
         } \
-        prev_trigger = trigger;
+        patch_state->prev_trigger = trigger;
+
+//////////////////////////////////
+// Procedural
+//////////////////////////////////
+
+// Pixel macros form the body of PIXEL_PATCH() entries in config.h. They are
+// expanded within the pixel function of the patch (see effect.cpp), where they
+// write the color of the pixel at index into rgb. t counts the frames rendered
+// since the patch has been selected. As pixels are computed while the frame is
+// transmitted, pixel macros require no frame buffer and work on strips of any
+// length. Pixel macros may be combined with plain code, ex.
+// PIXEL_ROTATE_RAINBOW(8); nscale8x3(rgb, 128)
+
+/* PIXEL_SET_ALL
+ * -------------
+ * Parameters:
+ *      _R - Red value (0 - 255)
+ *      _G - Green value (0 - 255)
+ *      _B - Blue value (0 - 255)
+ * Description:
+ *      Sets every pixel to one color.
+ */
+#define PIXEL_SET_ALL(_R, _G, _B) \
+        rgb[R] = _R; \
+        rgb[G] = _G; \
+        rgb[B] = _B;
 
+/* PIXEL_SPLIT
+ * -----------
+ * Parameters:
+ *      R1, G1, B1 - Color of the pixels before SPLIT
+ *      R2, G2, B2 - Color of the remaining pixels
+ *      SPLIT - Index of the first pixel of the second color
+ * Description:
+ *      Splits the strip into two colors.
+ */
+#define PIXEL_SPLIT(R1, G1, B1, R2, G2, B2, SPLIT) \
+        if (index < (SPLIT)) { \
+                PIXEL_SET_ALL(R1, G1, B1) \
+        } else { \
+                PIXEL_SET_ALL(R2, G2, B2) \
+        }
+
+/* PIXEL_RAINBOW
+ * -------------
+ * Parameters:
+ *      STEP_SIZE - 8-bit hue steps (0 - 255) between each frame
+ * Description:
+ *      Fades all pixels simultaneously through the color wheel.
+ */
+#define PIXEL_RAINBOW(STEP_SIZE) rgb_hue((uint16_t)(t * (STEP_SIZE)) << 8, rgb);
+
+/* PIXEL_ROTATE_RAINBOW
+ * --------------------
+ * Parameters:
+ *      STEP_SIZE - 8-bit hue steps (0 - 255) between each pixel and frame
+ * Description:
+ *      Rotates the color wheel across the strip.
+ */
+#define PIXEL_ROTATE_RAINBOW(STEP_SIZE) rgb_hue((uint16_t)((t + index) * (STEP_SIZE)) << 8, rgb);
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Settings persisted across power cycles in a wear
+ *              leveled EEPROM journal.
+ *
+ *              Rather than overwriting the same cells on every save,
+ *              each save appends a record to a ring spanning the
+ *              entire EEPROM. Every cell is thereby written only once
+ *              per lap of the ring, extending the EEPROM's life by the
+ *              number of records it holds (102 on the ATtiny85).
+ *
+ *              Records carry a sequence number, one above that of the
+ *              previous record, and a CRC. The latest record is the only
+ *              valid record not followed by its successor, which a single
+ *              pass over the ring finds at boot. A record torn by a power
+ *              loss fails its CRC, leaving the previous record in effect.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "config.h"
+#include "input.h"
+#include "settings.h"
+
+////////////////////////
+// Records
+////////////////////////
+
+// Record layout, in bytes. Multi-byte values are stored
+// little endian, keeping records free of padding.
+#define REC_SEQ         0       // Sequence number
+#define REC_PATCH       1       // settings.patch
+#define REC_STRIP_SIZE  2       // settings.strip_size (2 bytes)
+#define REC_CRC         4       // CRC-8 of all preceding bytes
+#define REC_SIZE        5
+
+// Sequence numbers are 8-bit, which unambiguously orders
+// successive records as long as the ring holds less than 256
+#define RING_SLOTS (((E2END + 1) / REC_SIZE) < 255 ? ((E2END + 1) / REC_SIZE) : 255)
+
+uint8_t settings_ring[RING_SLOTS][REC_SIZE] EEMEM;
+
+settings eeprom_settings = {0, 0};
+
+static uint8_t head;            // Slot of the latest record
+static uint8_t head_seq;        // Sequence number of the latest record
+static bool journaled = false;  // The journal holds a valid record
+static settings last;           // Settings of the latest record
+
+/* crc8
+ * ----
+ * Parameters:
+ *      rec - Record
+ * Returns:
+ *      CRC-8 (polynomial 0x31, initial value 0xFF) of the record,
+ *      excluding its CRC byte. Neither erased (0xFF) nor zeroed
+ *      records pass the check.
+ */
+static uint8_t crc8(const uint8_t *rec)
+{
+        uint8_t crc = 0xFF;
+
+        for (uint8_t i = 0; i < REC_CRC; i++) {
+                crc ^= rec[i];
+
+                for (uint8_t bit = 0; bit < 8; bit++)
+                        crc = (crc & 0x80) ? (crc << 1) ^ 0x31 : (crc << 1);
+        }
+
+        return crc;
+}
+
+/* rec_read
+ * --------
+ * Parameters:
+ *      slot - Slot of the ring
+ *      rec - Buffer of REC_SIZE bytes receiving the record
+ * Returns:
+ *      True if the record passes its CRC
+ */
+static bool rec_read(uint8_t slot, uint8_t *rec)
+{
+        for (uint8_t i = 0; i < REC_SIZE; i++)
+                rec[i] = eeprom_read_byte(&settings_ring[slot][i]);
+
+        return rec[REC_CRC] == crc8(rec);
+}
+
+/* crc_clash
+ * ---------
+ * Parameters:
+ *      old - Record currently held by the slot
+ *      rec - Record about to be written to the slot
+ *      crc - CRC byte left in the slot
+ * Returns:
+ *      True if a write torn after any of the record's bytes
+ *      would leave a record passing its CRC
+ */
+static bool crc_clash(const uint8_t *old, const uint8_t *rec, uint8_t crc)
+{
+        uint8_t mix[REC_SIZE];
+
+        for (uint8_t i = 0; i < REC_SIZE; i++)
+                mix[i] = old[i];
+
+        for (uint8_t i = 0; i < REC_CRC; i++) {
+                mix[i] = rec[i];
+                if (crc8(mix) == crc)
+                        return true;
+        }
+
+        return false;
+}
+
+////////////////////////
+// Functions
+////////////////////////
+
+/* settings_load
+ * -------------
+ * Description:
+ *      Loads the latest valid record of the journal into
+ *      eeprom_settings. Reads every record once, at most.
+ *      If the journal holds no valid record, as after the
+ *      EEPROM has been erased or zeroed, the settings are
+ *      zeroed, meaning the strip must be calibrated again.
+ */
+void settings_load()
+{
+        uint8_t rec[REC_SIZE], next[REC_SIZE];
+        bool valid = rec_read(0, rec);
+
+        // Start over at the first slot if no record is found
+        head = RING_SLOTS - 1;
+        head_seq = 0xFF;
+        journaled = false;
+        eeprom_settings.patch = 0;
+        eeprom_settings.strip_size = 0;
+
+        for (uint8_t slot = 0; slot < RING_SLOTS; slot++) {
+                uint8_t succ = (slot + 1 < RING_SLOTS) ? slot + 1 : 0;
+                bool next_valid = rec_read(succ, next);
+
+                if (valid && !(next_valid && next[REC_SEQ] == (uint8_t)(rec[REC_SEQ] + 1))) {
+                        head = slot;
+                        head_seq = rec[REC_SEQ];
+                        eeprom_settings.patch = rec[REC_PATCH];
+                        eeprom_settings.strip_size = rec[REC_STRIP_SIZE] | (rec[REC_STRIP_SIZE + 1] << 8);
+                        last = eeprom_settings;
+                        journaled = true;
+                        return;
+                }
+
+                for (uint8_t i = 0; i < REC_SIZE; i++)
+                        rec[i] = next[i];
+                valid = next_valid;
+        }
+}
+
+/* settings_save
+ * -------------
+ * Returns:
+ *      False if the write has been aborted due to a low
+ *      supply voltage, true otherwise
+ * Description:
+ *      Appends eeprom_settings to the journal, in the slot
+ *      following the latest record. Nothing is written if
+ *      the settings are unchanged. The CRC is written last,
+ *      so a record only becomes valid once complete. Takes
+ *      around 1 ms per byte, plus 3.4 ms per changed byte,
+ *      26.4 ms at most.
+ *
+ *      The supply voltage is checked before every byte (see
+ *      supply_ok()). If it drops, as when the tray is being
+ *      switched off, the write is aborted, leaving the
+ *      incomplete record invalid and the previous one in
+ *      effect. The next save then retries the same slot.
+ *
+ *      Should the CRC byte left in the slot happen to match
+ *      a partially written record, it is first replaced by
+ *      one that matches none, so a torn write can never be
+ *      mistaken for a valid record.
+ */
+bool settings_save()
+{
+        uint8_t rec[REC_SIZE], old[REC_SIZE];
+
+        if (journaled && last.patch == eeprom_settings.patch && last.strip_size == eeprom_settings.strip_size)
+                return true;
+
+        uint8_t slot = (head + 1 < RING_SLOTS) ? head + 1 : 0;
+
+        rec[REC_SEQ] = head_seq + 1;
+        rec[REC_PATCH] = eeprom_settings.patch;
+        rec[REC_STRIP_SIZE] = eeprom_settings.strip_size & 0xFF;
+        rec[REC_STRIP_SIZE + 1] = eeprom_settings.strip_size >> 8;
+        rec[REC_CRC] = crc8(rec);
+
+        rec_read(slot, old);
+
+        if (crc_clash(old, rec, old[REC_CRC])) {
+                uint8_t crc = old[REC_CRC];
+
+                do
+                        crc++;
+                while (crc == crc8(old) || crc_clash(old, rec, crc));
+
+                if (!supply_ok())
+                        return false;
+
+                eeprom_update_byte(&settings_ring[slot][REC_CRC], crc);
+        }
+
+        for (uint8_t i = 0; i < REC_SIZE; i++) {
+                if (!supply_ok())
+                        return false;
+
+                eeprom_update_byte(&settings_ring[slot][i], rec[i]);
+        }
+
+        head = slot;
+        head_seq++;
+        last = eeprom_settings;
+        journaled = true;
+
+        return true;
+}
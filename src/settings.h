@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Settings persisted across power cycles in a wear
+ *              leveled EEPROM journal.
+ *
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* settings
+ * --------
+ * Description:
+ *      Settings persisted across power cycles. Changes are
+ *      made to eeprom_settings and persisted by settings_save().
+ */
+typedef struct settings {
+        uint8_t patch;          // Patch selected at the last power-up
+        uint16_t strip_size;    // Calibrated strip size, 0 if uncalibrated
+} settings;
+
+extern settings eeprom_settings;
+
+void settings_load();
+bool settings_save();
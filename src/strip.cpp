@@ -21,22 +21,21 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 
 #include <avr/io.h>
-#include <avr/eeprom.h>
 #include <util/delay.h>
+#include <util/crc16.h>
 
+#include "color.h"
 #include "input.h"
 #include "ws2812.h"
 #include "strip.h"
-#include "time.h"
+#include "timer.h"
 
 #if STRIP_TYPE == WS2812
 
 const RGB_t off = {0, 0, 0};
 
-uint16_t eeprom_strip_size EEMEM = 0;
 uint16_t strip_size;
 
 /* strip_calibrate
@@ -50,80 +49,75 @@ uint16_t strip_size;
  *      the push button for more than a second. This function is
  *      executed after the first flash (see platformio.ini on how to flash a 
  *      controller for the first time), or  by holding down the push button for
- *      longer than 5 seconds.
+ *      longer than 5 seconds. If the length can't be saved due to a low
+ *      supply voltage, the strip doesn't blink and calibration continues.
+ *      The blink confirming the saved length is timed rather than delayed,
+ *      leaving the button polled throughout.
  */
 void strip_calibrate()
 {
-        substrpbuf buf;
-        buf.n_substrps = 3;
-        buf.substrps = (substrp *)malloc(sizeof(substrp) * 3);
+        uint8_t end = 0;
+        uint8_t blink = 0;      // Remaining blink phases once the length is saved
+        tmr_t blink_tmr;
+        rlebuf buf;
 
-        buf.substrps[0].length = 0;
-        buf.substrps[0].rgb[R] = 255;
-        buf.substrps[0].rgb[G] = 255;
-        buf.substrps[0].rgb[B] = 255;
-        
-        // End point
-        buf.substrps[1].length = 1;
-        buf.substrps[1].rgb[R] = 0;
-        buf.substrps[1].rgb[G] = 255;
-        buf.substrps[1].rgb[B] = 0;
-
-        buf.substrps[2].length = 255;
-        buf.substrps[2].rgb[R] = 0;
-        buf.substrps[2].rgb[G] = 0;
-        buf.substrps[2].rgb[B] = 0;
-
-        strip_apply_substrpbuf(buf);
-
-        while (BTN_STATE);
-
-        bool prev_btn_state = BTN_STATE;
+        rlebuf_calibrate(&buf, end);
+        strip_apply_rlebuf(&buf);
 
         uint8_t pot = pot_avg(255);
         uint8_t prev_pot = pot;
 
+        // A long press entering calibration doesn't
+        // generate further events once released
         while(true) {
-                bool btn_state = BTN_STATE;
+                uint8_t event = button_event();
 
-                if (!prev_btn_state && btn_state) { // Button press
-#if defined(BTN_DEBOUNCE_TIME) && BTN_DEBOUNCE_TIME > 0
-                        DELAY_MS(BTN_DEBOUNCE_TIME);
-#endif
-                        reset_timer();
-                } else if (btn_state) {
-                        if (ms_passed() >= 1000) { // Button held for 1 sec 
-                                strip_size = buf.substrps[0].length + 1;
-                                SET_STRIP_SIZE(strip_size);
-                                
-                                // Blink strip
-                                for (uint8_t i = 0; i < 3; i++) {
-                                        strip_apply_all((RGB_ptr_t) off);
-                                        DELAY_MS(200);
-                                        strip_apply_substrpbuf(buf);
-                                        DELAY_MS(200);
-                                }
-                                strip_apply_all((RGB_ptr_t) off);
-                                DELAY_MS(200);
+                // Blink strip, alternating every 200 ms between off and
+                // the endpoint, starting and ending with off
+                if (blink) {
+                        if (tmr_expired(&blink_tmr, 200)) {
+                                tmr_reset(&blink_tmr);
 
-                                return;
+                                if (--blink == 0)
+                                        return;
                         }
+
+                        if (blink & 1)
+                                strip_apply_all((RGB_ptr_t) off);
+                        else
+                                strip_apply_rlebuf(&buf);
+
+                        continue;
+                }
+
+                switch (event) {
+                case BTN_CLICK:
+                case BTN_DOUBLE_CLICK:
+                        if (end < 254)
+                                end++;
+                        break;
+                case BTN_LONG_PRESS: // Button held for BTN_LONG_PRESS_MS
+                        // Supply too low to save, keep calibrating
+                        // so the length can be applied again
+                        if (!SET_STRIP_SIZE(end + 1))
+                                break;
+
+                        strip_size = end + 1;
+
+                        blink = 7;
+                        tmr_reset(&blink_tmr);
                         continue;
-                } else if (prev_btn_state && !btn_state) { // Button Released
-                        buf.substrps[0].length++;
-                        buf.substrps[2].length--;
                 }
 
                 pot = pot_avg(255);
 
                 // Pot has been moved
                 if (pot != prev_pot) {
-                        buf.substrps[0].length = pot;
-                        buf.substrps[2].length = 254 - pot;
+                        end = (pot < 254) ? pot : 254;
                 }
-                
-                strip_apply_substrpbuf(buf);
-                prev_btn_state = btn_state;
+
+                rlebuf_calibrate(&buf, end);
+                strip_apply_rlebuf(&buf);
                 prev_pot = pot;
         }
 }
@@ -175,6 +169,153 @@ void rgb_cpy(RGB_ptr_t dst, RGB_t src)
         dst[B] = src[B];
 }
 
+#if STRIP_TYPE == WS2812
+
+/* rgb_to_wire
+ * -----------
+ * Parameters:
+ *      dst - Three byte buffer to store the reordered value
+ *      src - Source RGB object
+ * Description:
+ *      Reorders an RGB object into the color order expected
+ *      by the strip, so that it may be passed to ws2812_tx_buffer().
+ */
+static inline void rgb_to_wire(uint8_t *dst, const uint8_t *src)
+{
+        dst[0] = src[WS2812_WIRING_RGB_0];
+        dst[1] = src[WS2812_WIRING_RGB_1];
+        dst[2] = src[WS2812_WIRING_RGB_2];
+}
+
+////////////////////////
+// Dirty Frame Detection
+////////////////////////
+
+// The strip_apply_* functions checksum the data they are about to transmit
+// and skip the transmission entirely if the checksum matches that of the
+// last transmitted frame, and the strip (or capture buffer, see ws2812.h)
+// hasn't been written to since. Static patches thereby only transmit
+// when their colors change, leaving interrupts enabled and the MCU idle.
+// The checksum is a CRC-16 (CCITT), which avr-libc computes in a handful
+// of cycles per byte without any multiplication. Unlike a plain or rotated
+// sum, it catches every change confined to two adjacent bytes, such as one
+// byte rising while the next one drops. As any 16-bit checksum, it may yet
+// collide for larger changes, hence frames are retransmitted regardless
+// every FRAME_REFRESH_MS, bounding how long a strip may stay stale (which
+// also recovers pixels corrupted by noise on the data line).
+
+#ifndef FRAME_REFRESH_MS
+#define FRAME_REFRESH_MS 1000
+#endif
+
+// Tags keeping identical data of different containers apart
+enum frame_tag {
+        FRAME_ALL,
+        FRAME_SUBSTRPBUF,
+        FRAME_RGBBUF,
+        FRAME_DROPSET,
+        FRAME_PALBUF,
+        FRAME_RLEBUF
+};
+
+static uint16_t frame_sum;              // Checksum of the last transmitted frame
+static uint16_t frame_seq;              // ws2812_seq after the last transmitted frame
+static const uint8_t *frame_dest;       // Capture buffer of the last transmitted frame
+static tmr_t frame_tmr;                 // Time since the last transmitted frame
+
+/* frame_sum_add
+ * -------------
+ * Parameters:
+ *      sum - Checksum to be extended
+ *      data - Data to be added
+ *      len - Number of bytes
+ * Returns:
+ *      Checksum extended by the data
+ */
+static uint16_t frame_sum_add(uint16_t sum, const void *data, uint16_t len)
+{
+        const uint8_t *p = (const uint8_t *)data;
+
+        while (len--)
+                sum = _crc_ccitt_update(sum, *p++);
+
+        return sum;
+}
+
+/* frame_sum_start
+ * ---------------
+ * Parameters:
+ *      tag - Container of the frame
+ * Returns:
+ *      Initial checksum of a frame
+ */
+static uint16_t frame_sum_start(uint8_t tag)
+{
+        uint8_t hdr[] = {tag, (uint8_t)strip_size, (uint8_t)(strip_size >> 8)};
+
+        return frame_sum_add(0xFFFF, hdr, sizeof(hdr));
+}
+
+/* frame_sum_px
+ * ------------
+ * Parameters:
+ *      sum - Checksum to be extended
+ *      px - Pixel to be added
+ * Returns:
+ *      Checksum extended by the position and color of the pixel
+ */
+static uint16_t frame_sum_px(uint16_t sum, const pxl *px)
+{
+        sum = frame_sum_add(sum, &px->pos, sizeof(px->pos));
+        return frame_sum_add(sum, px->rgb, sizeof(RGB_t));
+}
+
+/* frame_skip
+ * ----------
+ * Parameters:
+ *      sum - Checksum of the frame about to be transmitted
+ * Returns:
+ *      True if the frame is already shown and
+ *      may be skipped, which it never is while
+ *      the strip is dithered (see ws2812_correct())
+ *      or FRAME_REFRESH_MS have passed since the
+ *      last transmission
+ */
+static bool frame_skip(uint16_t sum)
+{
+#ifdef WS2812_CAPTURE
+        const uint8_t *dest = ws2812_capture_tee ? NULL : ws2812_capture_buf;
+#else
+        const uint8_t *dest = NULL;
+#endif
+
+        // Frames relying on dithering are retransmitted regardless
+        bool refresh = (!dest && WS2812_DITHERING) || tmr_expired(&frame_tmr, FRAME_REFRESH_MS);
+
+        if (sum == frame_sum && ws2812_seq == frame_seq && dest == frame_dest && !refresh)
+                return true;
+
+        frame_sum = sum;
+        frame_dest = dest;
+
+        return false;
+}
+
+/* frame_sent
+ * ----------
+ * Description:
+ *      Marks the frame passed to the last frame_skip()
+ *      call as transmitted. Must be called right after
+ *      ws2812_end_tx().
+ */
+static void frame_sent()
+{
+        frame_seq = ws2812_seq;
+        tmr_reset(&frame_tmr);
+}
+
+#endif
+
 /* rgb_apply_brightness
  * --------------------
  * Parameters:
@@ -182,15 +323,11 @@ void rgb_cpy(RGB_ptr_t dst, RGB_t src)
  *      brightness - Brightness to be applied to the RGB object
  * Description:
  *      Applies a brightness (0 = 0%, 255 = 100%) to the provided
- *      RGB object.
+ *      RGB object. See nscale8x3 in color.h.
  */
 void rgb_apply_brightness(RGB_ptr_t rgb, uint8_t brightness)
 {
-        if (brightness < 255) {
-                rgb[R] = round(((double)brightness/255) * (double)rgb[R]);
-                rgb[G] = round(((double)brightness/255) * (double)rgb[G]);
-                rgb[B] = round(((double)brightness/255) * (double)rgb[B]);
-        }
+        nscale8x3(rgb, brightness);
 }
 
 /* substripbuf_apply_brightness
@@ -206,240 +343,678 @@ void substripbuf_apply_brightness(substrpbuf *substrpbuf, uint8_t brightness)
 {
         if (brightness < 255) {
                 for (uint16_t i = 0; i < substrpbuf->n_substrps; i++) 
-                        rgb_apply_brightness(substrpbuf->substrps[i].rgb, brightness);
+                        nscale8x3(substrpbuf->substrps[i].rgb, brightness);
         }
 }
 
-/* rgb_apply_fade
- * --------------
+/* rgb_hue_spectrum
+ * ----------------
  * Parameters:
- *      rgb - RGB object to store fade values
- *      step_size - Color steps after each call
+ *      hue - 16-bit hue (see rgb_hue)
+ *      rgb - RGB object to store the color
  * Description:
- *      Apples rgb fading to the provided rgb object.
+ *      Maps a hue to the RGB spectrum, where each pair of
+ *      neighbouring primaries is crossfaded linearly over a
+ *      third of the color wheel.
  */
-void rgb_apply_fade(RGB_ptr_t rgb, uint8_t step_size)
+void rgb_hue_spectrum(uint16_t hue, RGB_ptr_t rgb)
 {
-        bool r2g;
+        uint32_t pos = (uint32_t)hue * 3;
+        uint8_t frac = pos >> 8;        // Position within the third
 
-        // Invalid RGB, correct it!
-        if (rgb[R] != 0 && rgb[G] != 0 && rgb[B] != 0) {
-                rgb[R] = 255;
+        switch ((uint8_t)(pos >> 16)) {
+        case 0:
+                rgb[R] = 255 - frac;
+                rgb[G] = frac;
+                rgb[B] = 0;
+                break;
+        case 1:
+                rgb[R] = 0;
+                rgb[G] = 255 - frac;
+                rgb[B] = frac;
+                break;
+        default:
+                rgb[R] = frac;
                 rgb[G] = 0;
+                rgb[B] = 255 - frac;
+                break;
+        }
+}
+
+/* rgb_hue_rainbow
+ * ---------------
+ * Parameters:
+ *      hue - 16-bit hue (see rgb_hue)
+ *      rgb - RGB object to store the color
+ * Description:
+ *      Maps a hue to the rainbow, which splits the color
+ *      wheel into eighths (red, orange, yellow, green, aqua,
+ *      blue, purple, pink). Compared to the RGB spectrum,
+ *      yellow gets wider and green narrower, giving a more
+ *      even perceived spread of colors.
+ */
+void rgb_hue_rainbow(uint16_t hue, RGB_ptr_t rgb)
+{
+        uint8_t offset = hue >> 5;      // Position within the eighth
+        uint8_t third = scale8(offset, 85);
+        uint8_t twothirds = scale8(offset, 170);
+
+        switch (hue >> 13) {
+        case 0: // Red to orange
+                rgb[R] = 255 - third;
+                rgb[G] = third;
                 rgb[B] = 0;
-        }        
+                break;
+        case 1: // Orange to yellow
+                rgb[R] = 171;
+                rgb[G] = 85 + third;
+                rgb[B] = 0;
+                break;
+        case 2: // Yellow to green
+                rgb[R] = 171 - twothirds;
+                rgb[G] = 170 + third;
+                rgb[B] = 0;
+                break;
+        case 3: // Green to aqua
+                rgb[R] = 0;
+                rgb[G] = 255 - third;
+                rgb[B] = third;
+                break;
+        case 4: // Aqua to blue
+                rgb[R] = 0;
+                rgb[G] = 171 - twothirds;
+                rgb[B] = 85 + twothirds;
+                break;
+        case 5: // Blue to purple
+                rgb[R] = third;
+                rgb[G] = 0;
+                rgb[B] = 255 - third;
+                break;
+        case 6: // Purple to pink
+                rgb[R] = 85 + third;
+                rgb[G] = 0;
+                rgb[B] = 171 - third;
+                break;
+        default: // Pink to red
+                rgb[R] = 170 + third;
+                rgb[G] = 0;
+                rgb[B] = 85 - third;
+                break;
+        }
+}
+
+#if STRIP_TYPE == WS2812
+
+/* substripbuf_cpy
+ * ---------------
+ * Parameters:
+ *      dst - Strip object to store copy
+ *      src - Strip object to be copied
+ * Description:
+ *      Creates a deep copy of a substrip object.
+ */
+void substripbuf_cpy(substrpbuf *dst, substrpbuf *src)
+{
+        dst->substrps = (substrp *)malloc(sizeof(substrp) * src->n_substrps);
+        dst->n_substrps = src->n_substrps;
+        memcpy(dst->substrps, src->substrps, sizeof(substrp) * dst->n_substrps);
+}
+
+/* substrpbuf_free
+ * ---------------
+ * Parameters:
+ *      substrpbuf - Pointer to the substrip buffer to be freed
+ * Description:
+ *      Frees a substrip buffer.
+ */
+void substrpbuf_free(substrpbuf *substrpbuf)
+{
+        free(substrpbuf->substrps);
+}
 
-        r2g = (rgb[G] < 255 && rgb[B] == 0);
+/* dropset_init
+ * ------------
+ * Parameters:
+ *      set - Pointer to a droplet set
+ * Description:
+ *      Empties a droplet set.
+ */
+void dropset_init(dropset *set)
+{
+        memset(set, 0, sizeof(dropset));
+}
 
-        uint8_t tmp;
+/* dropset_slot
+ * ------------
+ * Parameters:
+ *      set - Pointer to a droplet set
+ *      pos - Pixel position
+ * Returns:
+ *      Slot + 1 of the pixel at the provided position,
+ *      0 if none is assigned to it
+ */
+static uint8_t dropset_slot(dropset *set, uint16_t pos)
+{
+        if (pos >= DROPSET_PIXELS)
+                return 0;
 
-        if (step_size == 0)
-                step_size = 1;
+        uint8_t slots = set->slots[pos >> 1];
 
-        if (r2g) {
-                tmp = rgb[R];
-                tmp -= step_size;
+        return (pos & 1) ? (slots >> 4) : (slots & 0x0F);
+}
 
-                if (tmp > rgb[R]) {
-                        rgb[R] = 0;
-                        rgb[G] = tmp;
-                        rgb[B] = 255 - tmp;
-                } else {
-                        rgb[R] = tmp;
-                        rgb[G] += step_size;
-                }
-        } else if (rgb[G] > 0) {
-                tmp = rgb[G];
-                tmp -= step_size;
-
-                if (tmp > rgb[G]) {
-                        rgb[G] = 0;
-                        rgb[B] = tmp;
-                        rgb[R] = 255 - tmp;
-                } else {
-                        rgb[G] = tmp;
-                        rgb[B] += step_size;
-                }
-        } else {
-                tmp = rgb[B];
-                tmp -= step_size;
-
-                if (tmp > rgb[B]) {
-                        rgb[B] = 0;
-                        rgb[R] = tmp;
-                        rgb[G] = 255 - tmp;
-                } else {
-                        rgb[B] = tmp;
-                        rgb[R] += step_size;
-                }
+/* dropset_set_slot
+ * ----------------
+ * Parameters:
+ *      set - Pointer to a droplet set
+ *      pos - Pixel position, within DROPSET_PIXELS
+ *      slot - Slot + 1 of the pixel at the position, 0 if none
+ */
+static void dropset_set_slot(dropset *set, uint16_t pos, uint8_t slot)
+{
+        uint8_t *slots = &set->slots[pos >> 1];
+
+        if (pos & 1)
+                *slots = (*slots & 0x0F) | (slot << 4);
+        else
+                *slots = (*slots & 0xF0) | slot;
+}
+
+/* dropset_insert
+ * --------------
+ * Parameters:
+ *      set - Pointer to a droplet set
+ *      pos - Position of the pixel to be inserted
+ *      rgb - RGB value of the pixel
+ * Returns:
+ *      true - Pixel inserted or updated
+ *      false - Set is full or position is out of range
+ * Description:
+ *      Adds a pixel to the droplet set, or updates its color
+ *      if the position is already occupied.
+ */
+bool dropset_insert(dropset *set, uint16_t pos, RGB_t rgb)
+{
+        if (pos >= DROPSET_PIXELS)
+                return false;
+
+        uint8_t slot = dropset_slot(set, pos);
 
+        if (slot) {
+                rgb_cpy(set->px[slot - 1].rgb, rgb);
+                return true;
         }
+
+        if (set->size == DROPSET_SIZE)
+                return false;
+
+        set->px[set->size].pos = pos;
+        rgb_cpy(set->px[set->size].rgb, rgb);
+        set->size++;
+        dropset_set_slot(set, pos, set->size);
+
+        return true;
 }
 
-#if STRIP_TYPE == WS2812
+/* dropset_exists
+ * --------------
+ * Parameters:
+ *      set - Pointer to a droplet set
+ *      pos - Pixel position
+ * Returns:
+ *      Whether a pixel is assigned to the position
+ */
+bool dropset_exists(dropset *set, uint16_t pos)
+{
+        return dropset_slot(set, pos) != 0;
+}
 
-/* substripbuf_cpy
+/* dropset_remove
+ * --------------
+ * Parameters:
+ *      set - Pointer to a droplet set
+ *      slot - Slot (NOT POSITION!) of the pixel to be deleted
+ * Description:
+ *      Deletes the pixel stored in the provided slot by moving
+ *      the last pixel of the set into it. When removing while
+ *      iterating, the same slot must thus be visited again.
+ */
+void dropset_remove(dropset *set, uint8_t slot)
+{
+        dropset_set_slot(set, set->px[slot].pos, 0);
+        set->size--;
+
+        if (slot != set->size) {
+                set->px[slot] = set->px[set->size];
+                dropset_set_slot(set, set->px[slot].pos, slot + 1);
+        }
+}
+
+/* palbuf_init
+ * -----------
+ * Parameters:
+ *      buf - Pointer to a palette buffer
+ * Description:
+ *      Initializes a palette buffer, with every pixel
+ *      and palette color off.
+ */
+void palbuf_init(palbuf *buf)
+{
+        memset(buf, 0, sizeof(palbuf));
+}
+
+/* palbuf_set_color
+ * ----------------
+ * Parameters:
+ *      buf - Pointer to a palette buffer
+ *      index - Palette index (0 - 15)
+ *      rgb - RGB value of the palette color
+ * Description:
+ *      Sets a color of the palette. Colors are stored in the
+ *      strip's color order, ready to be transmitted.
+ */
+void palbuf_set_color(palbuf *buf, uint8_t index, RGB_t rgb)
+{
+        rgb_to_wire(buf->palette[index & (PALBUF_COLORS - 1)], rgb);
+}
+
+/* palbuf_gradient
  * ---------------
  * Parameters:
- *      dst - Strip object to store copy
- *      src - Strip object to be copied
+ *      buf - Pointer to a palette buffer
+ *      from - RGB value of palette index 0
+ *      to - RGB value of palette index 15
+ * Description:
+ *      Fills the palette with a linear gradient.
+ */
+void palbuf_gradient(palbuf *buf, RGB_t from, RGB_t to)
+{
+        RGB_t rgb;
+
+        for (uint8_t i = 0; i < PALBUF_COLORS; i++) {
+                uint8_t amount = i * (255 / (PALBUF_COLORS - 1));
+
+                rgb[R] = blend8(from[R], to[R], amount);
+                rgb[G] = blend8(from[G], to[G], amount);
+                rgb[B] = blend8(from[B], to[B], amount);
+                palbuf_set_color(buf, i, rgb);
+        }
+}
+
+/* palbuf_set
+ * ----------
+ * Parameters:
+ *      buf - Pointer to a palette buffer
+ *      pos - Position of the pixel
+ *      index - Palette index (0 - 15)
+ * Description:
+ *      Sets a pixel to a color of the palette.
+ *      Positions out of range are ignored.
+ */
+void palbuf_set(palbuf *buf, uint16_t pos, uint8_t index)
+{
+        if (pos >= PALBUF_PIXELS)
+                return;
+
+        uint8_t *px = &buf->px[pos >> 1];
+
+        index &= 0x0F;
+
+        if (pos & 1)
+                *px = (*px & 0x0F) | (index << 4);
+        else
+                *px = (*px & 0xF0) | index;
+}
+
+/* palbuf_get
+ * ----------
+ * Parameters:
+ *      buf - Pointer to a palette buffer
+ *      pos - Position of the pixel
+ * Returns:
+ *      Palette index of the pixel, 0 if out of range
+ */
+uint8_t palbuf_get(palbuf *buf, uint16_t pos)
+{
+        if (pos >= PALBUF_PIXELS)
+                return 0;
+
+        uint8_t px = buf->px[pos >> 1];
+
+        return (pos & 1) ? (px >> 4) : (px & 0x0F);
+}
+
+/* palbuf_fill
+ * -----------
+ * Parameters:
+ *      buf - Pointer to a palette buffer
+ *      index - Palette index (0 - 15)
+ * Description:
+ *      Sets every pixel to a color of the palette.
+ */
+void palbuf_fill(palbuf *buf, uint8_t index)
+{
+        index &= 0x0F;
+        memset(buf->px, index | (index << 4), sizeof(buf->px));
+}
+
+/* rlebuf_init
+ * -----------
+ * Parameters:
+ *      buf - Pointer to a run-length buffer
+ * Description:
+ *      Initializes an empty run-length buffer.
+ */
+void rlebuf_init(rlebuf *buf)
+{
+        buf->size = 0;
+}
+
+/* rlebuf_push
+ * -----------
+ * Parameters:
+ *      buf - Pointer to a run-length buffer
+ *      length - Number of pixels of the run (max RLE_LENGTH)
+ *      rgb - RGB value of the run
+ *      gradient - Fade into the color of the following run
+ * Returns:
+ *      False if the buffer is full, true otherwise
+ * Description:
+ *      Appends a run to the end of a run-length buffer.
+ */
+bool rlebuf_push(rlebuf *buf, uint16_t length, RGB_t rgb, bool gradient)
+{
+        if (buf->size >= RLEBUF_RUNS)
+                return false;
+
+        rlerun *run = &buf->runs[buf->size++];
+
+        if (length > RLE_LENGTH)
+                length = RLE_LENGTH;
+
+        run->length = gradient ? (length | RLE_GRADIENT) : length;
+        rgb_to_wire(run->rgb, rgb);
+
+        return true;
+}
+
+/* rlebuf_apply_brightness
+ * -----------------------
+ * Parameters:
+ *      buf - Pointer to a run-length buffer
+ *      brightness - Brightness to be applied to the run-length buffer
+ * Description:
+ *      Applies a brightness (0 = 0%, 255 = 100%) to the provided
+ *      run-length buffer.
+ */
+void rlebuf_apply_brightness(rlebuf *buf, uint8_t brightness)
+{
+        if (brightness < 255) {
+                for (uint8_t i = 0; i < buf->size; i++)
+                        nscale8x3(buf->runs[i].rgb, brightness);
+        }
+}
+
+/* rlebuf_split
+ * ------------
+ * Parameters:
+ *      buf - Pointer to a run-length buffer
+ *      first - RGB value of the pixels before the split
+ *      second - RGB value of the remaining pixels
+ *      split - Index of the first pixel of the second color
+ * Description:
+ *      Builds a frame splitting the strip in two colors.
+ */
+void rlebuf_split(rlebuf *buf, RGB_t first, RGB_t second, uint16_t split)
+{
+        if (split > strip_size)
+                split = strip_size;
+
+        rlebuf_init(buf);
+        rlebuf_push(buf, split, first, false);
+        rlebuf_push(buf, strip_size - split, second, false);
+}
+
+/* rlebuf_distribute
+ * -----------------
+ * Parameters:
+ *      buf - Pointer to a run-length buffer
+ *      rgb - Array of rgb values to be distributed
+ *      size - Size of the rgb array
+ *      gradient - Fade between the colors, rather than
+ *                 splitting the strip into solid sections
+ * Description:
+ *      Builds a frame evenly distributing an array of rgb values
+ *      across the strip. Colors past the first RLEBUF_RUNS are ignored.
+ *      Gradients start at the first color on the first pixel, and end
+ *      at the last color on the last pixel.
+ */
+void rlebuf_distribute(rlebuf *buf, RGB_t rgb[], uint8_t size, bool gradient)
+{
+        rlebuf_init(buf);
+
+        if (size > RLEBUF_RUNS)
+                size = RLEBUF_RUNS;
+
+        if (size == 0)
+                return;
+
+        // The last color of a gradient only covers the last pixel
+        uint8_t sections = (gradient && size > 1) ? size - 1 : size;
+        uint16_t pixels = (sections < size && strip_size) ? strip_size - 1 : strip_size;
+
+        for (uint8_t i = 0; i < sections; i++) {
+                uint16_t length = pixels / sections;
+
+                if (i == sections - 1)
+                        length += pixels % sections;
+
+                rlebuf_push(buf, length, rgb[i], sections < size);
+        }
+
+        if (sections < size)
+                rlebuf_push(buf, 1, rgb[size - 1], false);
+}
+
+/* rlebuf_calibrate
+ * ----------------
+ * Parameters:
+ *      buf - Pointer to a run-length buffer
+ *      end - Position of the end point (0 - 254)
+ * Description:
+ *      Builds the calibration frame (see strip_calibrate), lighting up
+ *      the pixels before the end point in white and the end point in
+ *      green, followed by black pixels up to the calibration limit of
+ *      255 pixels.
+ */
+void rlebuf_calibrate(rlebuf *buf, uint8_t end)
+{
+        RGB_t white = {255, 255, 255};
+        RGB_t green = {0, 255, 0};
+
+        if (end > 254)
+                end = 254;
+
+        rlebuf_init(buf);
+        rlebuf_push(buf, end, white, false);
+        rlebuf_push(buf, 1, green, false);
+        rlebuf_push(buf, 254 - end, (RGB_ptr_t) off, false);
+}
+
+#endif
+
+/* rainbow_init
+ * ------------
+ * Parameters:
+ *      state - Pointer to a rainbow state
+ * Description:
+ *      Initializes the state of a rainbow animation,
+ *      starting at red.
+ */
+void rainbow_init(rainbow_state *state)
+{
+        memset(state, 0, sizeof(rainbow_state));
+        tmr_expire(&state->tmr);
+}
+
+/* fade_init
+ * ---------
+ * Parameters:
+ *      state - Pointer to a fade state
+ * Description:
+ *      Initializes the state of a fade, starting at
+ *      zero brightness.
+ */
+void fade_init(fade_state *state)
+{
+        memset(state, 0, sizeof(fade_state));
+        tmr_expire(&state->tmr);
+        state->inc = true;
+}
+
+/* breathe_init
+ * ------------
+ * Parameters:
+ *      state - Pointer to a breathe state
+ * Description:
+ *      Initializes the state of a breathing animation.
+ *      Random breathing starts with white.
+ */
+void breathe_init(breathe_state *state)
+{
+        memset(state, 0, sizeof(breathe_state));
+        fade_init(&state->fade);
+        state->rgb[R] = 255;
+        state->rgb[G] = 255;
+        state->rgb[B] = 255;
+}
+
+/* breathe_rainbow_init
+ * --------------------
+ * Parameters:
+ *      state - Pointer to a breathe state
  * Description:
- *      Creates a deep copy of a substrip object.
+ *      Initializes the state of a rainbow breathing
+ *      animation, starting at red.
  */
-void substripbuf_cpy(substrpbuf *dst, substrpbuf *src)
+void breathe_rainbow_init(breathe_rainbow_state *state)
 {
-        dst->substrps = (substrp *)malloc(sizeof(substrp) * src->n_substrps);
-        dst->n_substrps = src->n_substrps;
-        memcpy(dst->substrps, src->substrps, sizeof(substrp) * dst->n_substrps);
+        breathe_init(state);
+        rgb_hue(state->hue, state->rgb);
 }
 
-/* substrpbuf_free
- * ---------------
+/* trigger_fade_init
+ * -----------------
  * Parameters:
- *      substrpbuf - Pointer to the substrip buffer to be freed
+ *      state - Pointer to a trigger fade state
  * Description:
- *      Frees a substrip buffer.
+ *      Initializes the state of a triggered fade.
  */
-void substrpbuf_free(substrpbuf *substrpbuf)
+void trigger_fade_init(trigger_fade_state *state)
 {
-        free(substrpbuf->substrps);
+        memset(state, 0, sizeof(trigger_fade_state));
+        fade_init(&state->fade);
+        state->done = true;
 }
 
-/* pxbuf_init
- * ----------
+/* rain_init
+ * ---------
  * Parameters:
- *      buf - Pointer to a pixel buffer
+ *      state - Pointer to a rain state
  * Description:
- *      Initializes a pixel buffer.
+ *      Initializes the state of a rain animation.
  */
-void pxbuf_init(pxbuf *buf)
+void rain_init(rain_state *state)
 {
-        buf->buf = NULL;
-        buf->size = 0;
+        memset(state, 0, sizeof(rain_state));
+        tmr_expire(&state->fade_tmr);
+        tmr_expire(&state->drop_tmr);
 }
 
-/* pxbuf_insert
+/* override_init
  * -------------
  * Parameters:
- *      buf - Pointer to a pixel buffer
- *      pos - Position of the pixel to be inserted
- *      rgb - RGB value of the pixel
+ *      state - Pointer to an override state
  * Description:
- *      Adds/Allocates a pixel in the pixel buffer.
+ *      Initializes the state of an override animation.
+ *      Random overrides start with white.
  */
-void pxbuf_insert(pxbuf *buf, uint16_t pos, RGB_t rgb)
+void override_init(override_state *state)
 {
-        if (buf->size == 0) {
-                buf->buf = (pxl *)malloc(sizeof(pxl));
-                buf->buf[0].pos = pos;
-                rgb_cpy(buf->buf[0].rgb, rgb);
-                buf->size++;
-                return;
-        }
-
-        for (uint16_t i = 0; i < buf->size; i++) {
-
-                // Pixel already allocated
-                if (buf->buf[i].pos == pos) {
-                        rgb_cpy(buf->buf[i].rgb, rgb);
-                        return;
-                }
-
-                // Not the last pixel in the pxbuf, insert and shift array!
-                if (buf->buf[i].pos > pos) {
-                        buf->size++;
-                        buf->buf = (pxl *)realloc(buf->buf, sizeof(pxl) * buf->size);
-
-                        for (uint16_t j = buf->size-1; j > i; j--) {
-                                pxl* prev_px = &(buf->buf[j-1]);
-                                buf->buf[j].pos = prev_px->pos;
-                                rgb_cpy(buf->buf[j].rgb, prev_px->rgb);
-                        }
-
-                        buf->buf[i].pos = pos;
-                        rgb_cpy(buf->buf[i].rgb, rgb);
-
-                        return;
-                }
-        }
-
-        // Last pixel in the pxbuf, simply append it!
-        buf->size++;
-        buf->buf = (pxl *)realloc(buf->buf, sizeof(pxl) * buf->size);
-        buf->buf[buf->size-1].pos = pos;
-        rgb_cpy(buf->buf[buf->size-1].rgb, rgb);
+        memset(state, 0, sizeof(override_state));
+        tmr_expire(&state->tmr);
+        state->rgb[R] = 255;
+        state->rgb[G] = 255;
+        state->rgb[B] = 255;
 }
 
-bool pxbuf_exists(pxbuf *buf, uint16_t pos)
+/* override_rainbow_init
+ * ---------------------
+ * Parameters:
+ *      state - Pointer to an override state
+ * Description:
+ *      Initializes the state of a rainbow override
+ *      animation, starting at red.
+ */
+void override_rainbow_init(override_rainbow_state *state)
 {
-        for (uint16_t i = 0; i < buf->size; i++) {
-                if (buf->buf[i].pos == pos)
-                        return true;
-                else if (buf->buf[i].pos > pos)                
-                        break;
-        }
+        override_init(state);
+        rgb_hue(state->hue, state->rgb);
+}
 
-        return false;
+/* swap_init
+ * ---------
+ * Parameters:
+ *      state - Pointer to a swap state
+ * Description:
+ *      Initializes the state of a swap or toggle patch.
+ */
+void swap_init(swap_state *state)
+{
+        memset(state, 0, sizeof(swap_state));
+        tmr_expire(&state->tmr);
 }
 
-/* pxbuf_remove
+/* move_div_init
  * -------------
  * Parameters:
- *      buf - Pointer to a pixel buffer
- *      index - Index of pixel element to be deleted
+ *      state - Pointer to a moving divider state
  * Description:
- *      Deletes the pixel object stored at the provided index (NOT POSITION!).
+ *      Initializes the state of a moving divider patch.
  */
-void pxbuf_remove(pxbuf *buf, uint16_t index)
+void move_div_init(move_div_state *state)
 {
-        buf->size--;
-        
-        if (buf->size == 0) {
-                free(buf->buf);
-                buf->buf = NULL;
-                return;
-        }
-
-        for (uint16_t i = index; i < buf->size; i++) {
-                buf->buf[i] = buf->buf[i+1];               
-        }
-
-        buf->buf = (pxl *)realloc(buf->buf, sizeof(pxl) * buf->size);
+        memset(state, 0, sizeof(move_div_state));
 }
 
-/* pxbuf_remove_at
- * ---------------
+/* twinkle_init
+ * ------------
  * Parameters:
- *      buf - Pointer to a pixel buffer
- *      pos - Position of pixel to be deleted from the pixel buffer
- * Returns:
- *      true - Pixel object deleted
- *      false - No pixel object assigned to the position
+ *      state - Pointer to a twinkle state
  * Description:
- *      Deletes the pixel object assigned to the position.
+ *      Initializes the state of a twinkle animation,
+ *      with every pixel off.
  */
-bool pxbuf_remove_at(pxbuf *buf, uint16_t pos)
+void twinkle_init(twinkle_state *state)
 {
-        for (uint16_t i = 0; i < buf->size; i++)
-        {
-                if (buf->buf[i].pos == pos) {
-                        pxbuf_remove(buf, i);
-                        return true;
-                }
-
-                // If no previous pixel has matched
-                // and we've reached a position exceeding pos,
-                // we can assume the position has no entry
-                // in the pxbuf
-                if (buf->buf[i].pos > pos) {
-                        return false;
-                }
-        }
-
-        return false;
+        memset(state, 0, sizeof(twinkle_state));
+        tmr_expire(&state->fade_tmr);
+        tmr_expire(&state->twinkle_tmr);
 }
 
-#endif
+/* pixel_init
+ * ----------
+ * Parameters:
+ *      state - Pointer to a pixel state
+ * Description:
+ *      Initializes the state of a procedural patch,
+ *      starting at t = 0.
+ */
+void pixel_init(pixel_state *state)
+{
+        memset(state, 0, sizeof(pixel_state));
+        tmr_expire(&state->tmr);
+}
 
 /* strip_apply_all
  * ---------------
@@ -451,13 +1026,16 @@ bool pxbuf_remove_at(pxbuf *buf, uint16_t pos)
 void strip_apply_all(RGB_ptr_t rgb)
 {
 #if STRIP_TYPE == WS2812
+        uint8_t px[3];
+        rgb_to_wire(px, rgb);
+
+        if (frame_skip(frame_sum_add(frame_sum_start(FRAME_ALL), px, sizeof(px))))
+                return;
+
         ws2812_prep_tx();
-        for (uint16_t i = 0; i < strip_size; i++) {
-                ws2812_tx_byte(rgb[WS2812_WIRING_RGB_0]);
-                ws2812_tx_byte(rgb[WS2812_WIRING_RGB_1]);
-                ws2812_tx_byte(rgb[WS2812_WIRING_RGB_2]);
-        }
+        ws2812_tx_repeat(px, sizeof(px), strip_size);
         ws2812_end_tx();
+        frame_sent();
 #else
         NON_ADDR_STRIP_R_OCR = rgb[R];
         NON_ADDR_STRIP_G_OCR = rgb[G];
@@ -465,6 +1043,59 @@ void strip_apply_all(RGB_ptr_t rgb)
 #endif
 }
 
+/* strip_apply_pixels
+ * ------------------
+ * Parameters:
+ *      state - State passed to the pixel function
+ *      pixel - Pixel function
+ * Description:
+ *      Transmits a frame computed pixel by pixel. Every pixel
+ *      is computed right before it is transmitted, hence no
+ *      frame buffer is required, regardless of the strip size.
+ *      Non-addressable strips show pixel 0.
+ */
+void strip_apply_pixels(void *state, pixel_fn pixel)
+{
+        RGB_t rgb;
+
+#if STRIP_TYPE == WS2812
+        uint8_t px[3];
+
+        ws2812_prep_tx();
+        for (uint16_t i = 0; i < strip_size; i++) {
+                pixel(state, i, rgb);
+                rgb_to_wire(px, rgb);
+                ws2812_tx_buffer(px, sizeof(px));
+        }
+        ws2812_end_tx();
+#else
+        pixel(state, 0, rgb);
+        strip_apply_all(rgb);
+#endif
+}
+
+/* strip_pixels
+ * ------------
+ * Parameters:
+ *      state - Pixel state
+ *      pixel - Pixel function
+ *      delay_ms - Delay in ms between frames
+ * Description:
+ *      Renders a procedural patch. Every delay_ms, a frame is
+ *      transmitted via strip_apply_pixels() and the animation
+ *      time t advances by one.
+ */
+void strip_pixels(pixel_state *state, pixel_fn pixel, uint16_t delay_ms)
+{
+        if (!tmr_expired(&state->tmr, delay_ms))
+                return;
+
+        strip_apply_pixels(state, pixel);
+        state->t++;
+
+        tmr_reset(&state->tmr);
+}
+
 #if STRIP_TYPE == WS2812
 
 /* strip_apply_substrpbuf
@@ -476,15 +1107,24 @@ void strip_apply_all(RGB_ptr_t rgb)
  */
 void strip_apply_substrpbuf(substrpbuf substrpbuf)
 {
+        uint8_t px[3];
+        uint16_t sum = frame_sum_start(FRAME_SUBSTRPBUF);
+
+        for (uint16_t i = 0; i < substrpbuf.n_substrps; i++) {
+                sum = frame_sum_add(sum, &substrpbuf.substrps[i].length, sizeof(uint16_t));
+                sum = frame_sum_add(sum, substrpbuf.substrps[i].rgb, sizeof(RGB_t));
+        }
+
+        if (frame_skip(sum))
+                return;
+
         ws2812_prep_tx();
         for (uint16_t i = 0; i < substrpbuf.n_substrps; i++) {
-                for (uint16_t j = 0; j < substrpbuf.substrps[i].length; j++) {
-                        ws2812_tx_byte(substrpbuf.substrps[i].rgb[WS2812_WIRING_RGB_0]);
-                        ws2812_tx_byte(substrpbuf.substrps[i].rgb[WS2812_WIRING_RGB_1]);
-                        ws2812_tx_byte(substrpbuf.substrps[i].rgb[WS2812_WIRING_RGB_2]);
-                }
+                rgb_to_wire(px, substrpbuf.substrps[i].rgb);
+                ws2812_tx_repeat(px, sizeof(px), substrpbuf.substrps[i].length);
         }
         ws2812_end_tx();
+        frame_sent();
 }
 
 /* strip_apply_RGBbuf
@@ -496,13 +1136,21 @@ void strip_apply_substrpbuf(substrpbuf substrpbuf)
  */
 void strip_apply_RGBbuf(RGBbuf RGBbuf)
 {
+        if (frame_skip(frame_sum_add(frame_sum_start(FRAME_RGBBUF), RGBbuf, strip_size * sizeof(RGB_t))))
+                return;
+
         ws2812_prep_tx();
-        for (uint8_t i = 0; i < strip_size; i++) {
-                ws2812_tx_byte(RGBbuf[i][WS2812_WIRING_RGB_0]);
-                ws2812_tx_byte(RGBbuf[i][WS2812_WIRING_RGB_1]);
-                ws2812_tx_byte(RGBbuf[i][WS2812_WIRING_RGB_2]);
+#if WS2812_COLOR_ORDER == RGB
+        ws2812_tx_buffer((const uint8_t *)RGBbuf, strip_size * sizeof(RGB_t));
+#else
+        uint8_t px[3];
+        for (uint16_t i = 0; i < strip_size; i++) {
+                rgb_to_wire(px, RGBbuf[i]);
+                ws2812_tx_buffer(px, sizeof(px));
         }
+#endif
         ws2812_end_tx();
+        frame_sent();
 }
 
 /* strip_distribute_rgb
@@ -512,74 +1160,97 @@ void strip_apply_RGBbuf(RGBbuf RGBbuf)
  *      size - Size of the rgb array
  * Description:
  *      Evenly distributes an array of rgb values across the LED strip.
+ *      Colors past the first RLEBUF_RUNS are ignored.
  */
 void strip_distribute_rgb(RGB_t rgb[], uint16_t size)
 {
-        substrpbuf substrpbuf;
-        substrpbuf.n_substrps = size;
-        substrpbuf.substrps = (substrp *)malloc(sizeof(substrp) * size);
+        rlebuf buf;
 
-        for (uint16_t i = 0; i < size; i++) {
-                substrpbuf.substrps[i].length = strip_size/size;
-
-                if (i == size - 1)
-                        substrpbuf.substrps[i].length += strip_size % size;
+        rlebuf_distribute(&buf, rgb, size > RLEBUF_RUNS ? RLEBUF_RUNS : size, false);
+        strip_apply_rlebuf(&buf);
+}
 
-                rgb_cpy(substrpbuf.substrps[i].rgb, rgb[i]);
-        }
+/* strip_gradient_rgb
+ * ------------------
+ * Parameters:
+ *      rgb - Array of rgb values to fade between
+ *      size - Size of the rgb array
+ * Description:
+ *      Evenly fades between an array of rgb values across
+ *      the LED strip, from the first to the last pixel.
+ */
+void strip_gradient_rgb(RGB_t rgb[], uint16_t size)
+{
+        rlebuf buf;
 
-        strip_apply_substrpbuf(substrpbuf);
-        substrpbuf_free(&substrpbuf);
+        rlebuf_distribute(&buf, rgb, size > RLEBUF_RUNS ? RLEBUF_RUNS : size, true);
+        strip_apply_rlebuf(&buf);
 }
 
 #endif
 
-bool rgb_apply_brightness_fade(RGB_ptr_t rgb_in, RGB_ptr_t rgb_out, uint16_t step_size, bool start)
+/* rgb_apply_brightness_fade
+ * -------------------------
+ * Parameters:
+ *      state - Fade state
+ *      rgb_in - RGB value to be faded
+ *      rgb_out - RGB object to store the faded value
+ *      step_size - Brightness steps after each call
+ *      start - Restart the fade from zero brightness
+ * Returns:
+ *      True - Brightness has returned to zero
+ *      False - Amidst fade
+ * Description:
+ *      Fades the brightness of the provided RGB value up and back down.
+ */
+bool rgb_apply_brightness_fade(fade_state *state, RGB_ptr_t rgb_in, RGB_ptr_t rgb_out, uint16_t step_size, bool start)
 {
-        static bool inc = true;
-        static int brightness = 0;
-
         if (start) {
-                inc = true;
-                brightness = 0;
+                state->inc = true;
+                state->brightness = 0;
         }
 
         rgb_cpy(rgb_out, rgb_in);
 
-        if (inc) {
-                brightness += step_size;
-                if (brightness >= 255) {
-                        brightness = 255;
-                        inc = false;
-                }
-                inc = brightness < 255;
+        if (state->inc) {
+                state->brightness += step_size;
+                if (state->brightness >= 255)
+                        state->brightness = 255;
+                state->inc = state->brightness < 255;
         } else { 
-                brightness -= step_size;
-                if (brightness < 0) {
-                        brightness = 0;
-                }
-                inc = brightness == 0;
+                state->brightness -= step_size;
+                if (state->brightness < 0)
+                        state->brightness = 0;
+                state->inc = state->brightness == 0;
         }
 
-        rgb_apply_brightness(rgb_out, brightness);
-        return (brightness == 0);
+        nscale8x3(rgb_out, state->brightness);
+        return (state->brightness == 0);
 }
 
-bool strip_fade(RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size, bool start)
+/* strip_fade
+ * ----------
+ * Parameters:
+ *      state - Fade state
+ *      rgb - RGB value to be faded
+ *      delay_ms - Delay in ms between each step
+ *      step_size - Brightness steps
+ *      start - Restart the fade from zero brightness
+ * Returns:
+ *      True - Fade completed
+ *      False - Amidst fade
+ * Description:
+ *      Fades the provided RGB value in and out across the entire strip.
+ */
+bool strip_fade(fade_state *state, RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size, bool start)
 {
-        static RGB_t rgb_out;
-
-        if (ms_passed() <= delay_ms)
+        if (tmr_elapsed(&state->tmr) <= delay_ms)
                 return false;
 
-        bool ret;
-        if (start)
-                ret = rgb_apply_brightness_fade(rgb, rgb_out, step_size, true);
-        else
-                ret = rgb_apply_brightness_fade(rgb, rgb_out, step_size, false);
+        bool ret = rgb_apply_brightness_fade(state, rgb, state->rgb_out, step_size, start);
         
-        strip_apply_all(rgb_out);
-        reset_timer();
+        strip_apply_all(state->rgb_out);
+        tmr_reset(&state->tmr);
 
         return ret;
 }
@@ -587,6 +1258,7 @@ bool strip_fade(RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size, bool start)
 /* strip_breathe
  * -------------
  * Parameters:
+ *      state - Breathe state
  *      rgb - RGB value to be "breathed"
  *      dealy_ms - Delay in ms between each step
  *      step_size - Color steps during breath
@@ -596,23 +1268,26 @@ bool strip_fade(RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size, bool start)
  * Description:
  *      "Breathes" the provided RGB value across the entire strip.
  */
-bool strip_breathe(RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size)
+bool strip_breathe(breathe_state *state, RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size)
 {
-        static bool done = false;
+        if (state->done) {
+                if (!tmr_expired(&state->pause, 2000))
+                        return false;
+                state->done = false;
+        }
 
-        if (done && ms_passed() < 2000)
-                return false;
-        else if (ms_passed() >= 2000)
-                done = false;
+        state->done = strip_fade(&state->fade, rgb, delay_ms, step_size, false);
 
-        done = strip_fade(rgb, delay_ms, step_size, false);
+        if (state->done)
+                tmr_reset(&state->pause);
 
-        return done;
+        return state->done;
 }
 
 /* strip_breathe_array
  * -------------------
  * Parameters:
+ *      state - Breathe state
  *      rgb - Arrat of RGB values to be "breathed"
  *      size - Size of the RGB array
  *      dealy_ms - Delay in ms between each step
@@ -620,125 +1295,101 @@ bool strip_breathe(RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size)
  * Description:
  *      "Breathes" the provided RGB values across the entire strip.
  */
-void strip_breathe_array(RGB_t rgb[], uint8_t size, uint16_t delay_ms, uint8_t step_size)
+void strip_breathe_array(breathe_state *state, RGB_t rgb[], uint8_t size, uint16_t delay_ms, uint8_t step_size)
 {
-        static uint8_t i = 0;
+        if (state->i >= size)
+                state->i = 0;
 
-        if(strip_breathe(rgb[i], delay_ms, step_size))
-                i = (i + 1) % size;
+        if (strip_breathe(state, rgb[state->i], delay_ms, step_size))
+                state->i = (state->i + 1) % size;
 }
 
 /* strip_rainbow
  * -------------
  * Parameters:
+ *      state - Rainbow state
  *      step_size - Color steps between each call.
  *                  A greater value results in faster fading.
  *      brightness - Brightness value (0 = 0%, 255 = 100%) of the fade
  * Description:
  *      Gradiently fades all LEDs simultaneously trough the RGB spectrum.
  */
-void strip_rainbow(uint8_t step_size, uint16_t delay, uint8_t brightness)
+void strip_rainbow(rainbow_state *state, uint8_t step_size, uint16_t delay, uint8_t brightness)
 {
-        static RGB_t rgb = {255, 0, 0};
-
-        RGB_t rgbcpy;
+        RGB_t rgb;
 
-        if (ms_passed() < delay)
+        if (!tmr_expired(&state->tmr, delay))
                 return;
 
-        rgb_apply_fade(rgb, step_size);
-        
-        if (brightness < 255) {
-                rgb_cpy(rgbcpy, rgb);
-                rgb_apply_brightness(rgbcpy, brightness);
-                strip_apply_all(rgbcpy);
-        } else {
-                strip_apply_all(rgb);
-        }
+        state->hue += step_size * HUE_STEP;
+
+        rgb_hue(state->hue, rgb);
+        if (brightness < 255)
+                nscale8x3(rgb, brightness);
+        strip_apply_all(rgb);
 
-        reset_timer();
+        tmr_reset(&state->tmr);
 }
 
 /* strip_scroll_rgb
  * -------------
  * Parameters:
- *      val - RGB wheel offset from start (red) 
+ *      hue - 16-bit hue (see rgb_hue)
+ *      brightness - Brightness value (0 = 0%, 255 = 100%)
  * Description:
- *      Sets the rgb strip to a value on a RGB wheel.
+ *      Sets the rgb strip to a hue on the color wheel.
  */
-
-void strip_scroll_rgb(uint16_t val, uint8_t brightness) {
+void strip_scroll_rgb(uint16_t hue, uint8_t brightness)
+{
         RGB_t rgb;
 
-        val %= 765;
-
-        if (val < 255 + 1) {
-                rgb[R] = 255 - val;
-                rgb[G] = val;
-                rgb[B] = 0;        
-        } else if (val < (2 * 255) + 1) {
-                val -= 255;
-                rgb[R] = 0;
-                rgb[G] = 255 - val;
-                rgb[B] = val;
-        } else {
-                val -= 510;
-                rgb[R] = val;
-                rgb[G] = 0;
-                rgb[B] = 255 - val;
-        }
-
-        rgb_apply_brightness(rgb, brightness);
+        rgb_hue(hue, rgb);
+        nscale8x3(rgb, brightness);
         strip_apply_all(rgb);
 }
 
 /* strip_breathe_random
  * --------------------
  * Parameters:
+ *      state - Breathe state
  *      step_size - Brightness steps during breath.
  * Description:
  *      "Breathes" random RGB values across the entire strip.
  *      Due to the rather poor randomness of rand(), the outcomes tend
  *      to be similar.
  */
-void strip_breathe_random(uint16_t delay_ms, uint8_t step_size)
+void strip_breathe_random(breathe_state *state, uint16_t delay_ms, uint8_t step_size)
 {
-        static RGB_t rgb;
-
-        if (rgb[R] == 0 && rgb[G] == 0 && rgb[B] == 0) {
-                rgb[R] = 255;
-                rgb[G] = 255;
-                rgb[B] = 255;
-        }
-        
-        if (strip_breathe(rgb, delay_ms, step_size)) {
-                rgb[R] = (rand() % 256);
-                rgb[G] = (rand() % 256);
-                rgb[B] = (rand() % 256);
+        if (strip_breathe(state, state->rgb, delay_ms, step_size)) {
+                state->rgb[R] = (rand() % 256);
+                state->rgb[G] = (rand() % 256);
+                state->rgb[B] = (rand() % 256);
         }
 }
 
 /* strip_breathe_rainbow
  * ---------------------
  * Parameters:
+ *      state - Breathe state
  *      breath_step_size - Brightness steps during breath.
  *      rgb_step_size - Color steps.
  * Description:
  *      Gradiently "Breathes" trough the rgb spectrum
  */
-void strip_breathe_rainbow(uint16_t delay_ms, uint8_t breath_step_size, uint8_t rgb_step_size)
+void strip_breathe_rainbow(breathe_rainbow_state *state, uint16_t delay_ms, uint8_t breath_step_size, uint8_t rgb_step_size)
 {
-        static RGB_t rgb = {255, 0, 0};
-
-        if (strip_breathe(rgb, delay_ms, breath_step_size))
-                rgb_apply_fade(rgb, rgb_step_size);
+        if (strip_breathe(state, state->rgb, delay_ms, breath_step_size)) {
+                state->hue += rgb_step_size * HUE_STEP;
+                rgb_hue(state->hue, state->rgb);
+        }
 }
 
 #if STRIP_TYPE == WS2812
 
 /* strip_rotate_rainbow
  * --------------------
- *  * Parameters:
+ * Parameters:
+ *      state - Rainbow state
  *      step_size - Color steps between each pixel
  * Description:
  *      Rotates the rgb spectrum across the strip.
@@ -747,67 +1398,158 @@ void strip_breathe_rainbow(uint16_t delay_ms, uint8_t breath_step_size, uint8_t
  *      changes in step size, and even just additional code can
  *      easily lead to uncomfortable lag.
  */
-void strip_rotate_rainbow(uint8_t step_size, uint16_t delay_ms)
+void strip_rotate_rainbow(rainbow_state *state, uint8_t step_size, uint16_t delay_ms)
 {
-        static RGB_t rgb = {255, 0 , 0};
-        
-        if (ms_passed() < delay_ms)
+        if (!tmr_expired(&state->tmr, delay_ms))
                 return;
 
-        rgb_apply_fade(rgb, step_size);
+        uint16_t step = step_size * HUE_STEP;
+        uint16_t hue = (state->hue += step);
+        RGB_t rgb;
+        uint8_t px[3];
+
+        ws2812_prep_tx();
+        for (uint16_t i = 0; i < strip_size; i++) {
+                rgb_hue(hue, rgb);
+                rgb_to_wire(px, rgb);
+                ws2812_tx_buffer(px, sizeof(px));
+                hue += step;
+        }
+        ws2812_end_tx();
+
+        tmr_reset(&state->tmr);
+}
+
+/* strip_apply_dropset
+ * -------------------
+ * Parameters:
+ *      set - Droplet set to be applied across the LED strip
+ * Description:
+ *      Applies a droplet set across the LED strip.
+ */
+void strip_apply_dropset(dropset *set)
+{
+        uint8_t px[3];
+        uint16_t sum = frame_sum_start(FRAME_DROPSET);
+
+        // Slots are unordered, an equal set may thus sum up differently,
+        // which merely costs a redundant transmission
+        for (uint8_t i = 0; i < set->size; i++)
+                sum = frame_sum_px(sum, &set->px[i]);
 
-        RGB_t tmp;
-        rgb_cpy(tmp, rgb);
+        if (frame_skip(sum))
+                return;
 
         ws2812_prep_tx();
-                for (uint16_t i = 0; i < strip_size; i++) {
-                        ws2812_tx_byte(tmp[WS2812_WIRING_RGB_0]);
-                        ws2812_tx_byte(tmp[WS2812_WIRING_RGB_1]);
-                        ws2812_tx_byte(tmp[WS2812_WIRING_RGB_2]);
-                        rgb_apply_fade(tmp, step_size);
+        for (uint16_t i = 0; i < strip_size; i++) {
+                uint8_t slot = dropset_slot(set, i);
+
+                if (slot) {
+                        rgb_to_wire(px, set->px[slot - 1].rgb);
+                        ws2812_tx_buffer(px, sizeof(px));
+                } else {
+                        ws2812_tx_repeat(off, sizeof(RGB_t), 1);
                 }
+        }
         ws2812_end_tx();
-
-        reset_timer();
+        frame_sent();
 }
 
-/* strip_apply_RGBbuf
+/* strip_apply_palbuf
  * ------------------
  * Parameters:
- *      pxbuf - Pixel buffer to be applied across the LED strip
+ *      buf - Palette buffer to be applied across the LED strip
  * Description:
- *      Applies a pixel buffer across the LED strip.
+ *      Applies a palette buffer across the LED strip, looking
+ *      up the palette color of every pixel as it is transmitted.
  */
-void strip_apply_pxbuf(pxbuf *buf)
+void strip_apply_palbuf(palbuf *buf)
 {
-        uint16_t px_i;
+        uint16_t n = (strip_size + 1) / 2;
+
+        if (n > sizeof(buf->px))
+                n = sizeof(buf->px);
 
-        if (buf->size == 0) {
-                strip_apply_all((RGB_ptr_t) off);
+        uint16_t sum = frame_sum_start(FRAME_PALBUF);
+        sum = frame_sum_add(sum, buf->palette, sizeof(buf->palette));
+        sum = frame_sum_add(sum, buf->px, n);
+
+        if (frame_skip(sum))
                 return;
-        }
 
-        px_i = 0;
-        
         ws2812_prep_tx();
         for (uint16_t i = 0; i < strip_size; i++) {
-                if (px_i < buf->size && i == buf->buf[px_i].pos) {
-                        ws2812_tx_byte(buf->buf[px_i].rgb[WS2812_WIRING_RGB_0]);
-                        ws2812_tx_byte(buf->buf[px_i].rgb[WS2812_WIRING_RGB_1]);
-                        ws2812_tx_byte(buf->buf[px_i].rgb[WS2812_WIRING_RGB_2]);
-                        px_i++;
+                if (i < PALBUF_PIXELS) {
+                        uint8_t index = buf->px[i >> 1];
+
+                        if (i & 1)
+                                index >>= 4;
+
+                        ws2812_tx_buffer(buf->palette[index & 0x0F], sizeof(RGB_t));
                 } else {
-                        ws2812_tx_byte(0);
-                        ws2812_tx_byte(0);
-                        ws2812_tx_byte(0); 
+                        ws2812_tx_repeat(off, sizeof(RGB_t), 1);
+                }
+        }
+        ws2812_end_tx();
+        frame_sent();
+}
+
+/* strip_apply_rlebuf
+ * ------------------
+ * Parameters:
+ *      buf - Run-length buffer to be applied across the LED strip
+ * Description:
+ *      Applies a run-length buffer across the LED strip, expanding
+ *      its runs as they are transmitted. Solid runs are repeated
+ *      straight from the buffer. Gradient runs are interpolated
+ *      with a fixed point step, costing a single division per run.
+ */
+void strip_apply_rlebuf(rlebuf *buf)
+{
+        uint16_t sum = frame_sum_start(FRAME_RLEBUF);
+
+        for (uint8_t i = 0; i < buf->size; i++) {
+                sum = frame_sum_add(sum, &buf->runs[i].length, sizeof(uint16_t));
+                sum = frame_sum_add(sum, buf->runs[i].rgb, sizeof(RGB_t));
+        }
+
+        if (frame_skip(sum))
+                return;
+
+        ws2812_prep_tx();
+        for (uint8_t i = 0; i < buf->size; i++) {
+                rlerun *run = &buf->runs[i];
+                uint16_t length = run->length & RLE_LENGTH;
+
+                if (!(run->length & RLE_GRADIENT) || i == buf->size - 1 || length < 2) {
+                        ws2812_tx_repeat(run->rgb, sizeof(RGB_t), length);
+                        continue;
+                }
+
+                // 8.8 fixed point blend amount, reaching the next
+                // run's color right after the last pixel of the run
+                uint8_t *from = run->rgb;
+                uint8_t *to = buf->runs[i + 1].rgb;
+                uint16_t step = 0x10000UL / length;
+                uint16_t amount = 0;
+                uint8_t px[3];
+
+                while (length--) {
+                        px[0] = blend8(from[0], to[0], amount >> 8);
+                        px[1] = blend8(from[1], to[1], amount >> 8);
+                        px[2] = blend8(from[2], to[2], amount >> 8);
+                        ws2812_tx_buffer(px, sizeof(px));
+                        amount += step;
                 }
         }
         ws2812_end_tx();
+        frame_sent();
 }
 
 /* strip_rain
  * ----------
  * Parameters:
+ *      state - Rain state
  *      rgb - RGB value of rain droplets
  *      max_drops - Maximum amount of visible "droplets" at a time
  *      min_t_appart - Minimum time in ms between drops
@@ -815,102 +1557,188 @@ void strip_apply_pxbuf(pxbuf *buf)
  *      dealy - Delay of droplet fading
  * Description:
  *      Creates a rain effect across the strip.
- *      Note that this effect makes use of an RGB buffer and will linearly increase 
- *      memory consumption with strip size. 
+ *      Droplets are held in the droplet set of the state, meaning
+ *      no more than DROPSET_SIZE (see config.h) droplets are visible at
+ *      a time, regardless of max_drops. Cost scales linearly with strip size.
  */
-void strip_rain(RGB_t rgb, uint16_t max_drops, uint16_t min_t_appart, uint16_t max_t_appart, uint16_t delay)
+void strip_rain(rain_state *state, RGB_t rgb, uint16_t max_drops, uint16_t min_t_appart, uint16_t max_t_appart, uint16_t delay)
 {
-        static pxbuf pxbuf = {
-                .size = 0,
-                .buf = NULL
-        };
-
-        static uint16_t wait_until = 0;
-
-        uint16_t ms;
+        dropset *drops = &state->drops;
         uint16_t pos;
         bool t_passed;
 
-        t_passed = ms_passed() >= wait_until;
-
-        for (uint16_t i = 0; i < pxbuf.size; i++) {
-                if (pxbuf.buf[i].rgb[R] == 0 && pxbuf.buf[i].rgb[G] == 0 && pxbuf.buf[i].rgb[B] == 0) {
-                        pxbuf_remove(&pxbuf, i);
-                } else if (t_passed) {
-                        if (pxbuf.buf[i].rgb[R] != 0)
-                                pxbuf.buf[i].rgb[R]--;
-                        if (pxbuf.buf[i].rgb[G] != 0)
-                                pxbuf.buf[i].rgb[G]--;
-                        if (pxbuf.buf[i].rgb[B] != 0)
-                                pxbuf.buf[i].rgb[B]--;                        
+        t_passed = tmr_expired(&state->fade_tmr, delay);
+
+        for (uint8_t i = 0; i < drops->size;) {
+                pxl *px = &drops->px[i];
+
+                // Removal moves the last droplet into this slot, revisit it
+                if (px->rgb[R] == 0 && px->rgb[G] == 0 && px->rgb[B] == 0) {
+                        dropset_remove(drops, i);
+                        continue;
+                }
+                
+                if (t_passed) {
+                        if (px->rgb[R] != 0)
+                                px->rgb[R]--;
+                        if (px->rgb[G] != 0)
+                                px->rgb[G]--;
+                        if (px->rgb[B] != 0)
+                                px->rgb[B]--;                        
                 }
+
+                i++;
         }
         
         if (t_passed)
-                wait_until = ms_passed() + delay;
-
-        t_passed = ms_passed() >= (rand() % (max_t_appart - min_t_appart + 1)) + min_t_appart;
+                tmr_reset(&state->fade_tmr);
 
-        if (t_passed && pxbuf.size < max_drops) {
-                pos = rand() % strip_size;
+        t_passed = tmr_expired(&state->drop_tmr, (rand() % (max_t_appart - min_t_appart + 1)) + min_t_appart);
 
-                if (!pxbuf_exists(&pxbuf, pos)) {
-                        pxbuf_insert(&pxbuf, pos, rgb);
-                        ms = ms_passed();
-                        
-                        if (ms < wait_until)
-                                wait_until -= ms;
-                        else
-                                wait_until = 0; // Already passed 
+        if (t_passed && drops->size < max_drops) {
+                // Droplets only fall on LEDs covered by the set
+                pos = rand() % (strip_size < DROPSET_PIXELS ? strip_size : DROPSET_PIXELS);
 
-                        reset_timer();   
-                }
+                if (!dropset_exists(drops, pos) && dropset_insert(drops, pos, rgb))
+                        tmr_reset(&state->drop_tmr);
         }
 
-        strip_apply_pxbuf(&pxbuf);
+        strip_apply_dropset(drops);
 }
 
-bool strip_override(RGB_t rgb, uint16_t delay)
+/* strip_override
+ * --------------
+ * Parameters:
+ *      state - Override state
+ *      rgb - RGB value to override the strip with
+ *      delay - Delay in ms between each overridden pixel
+ * Returns:
+ *      True - Entire strip overridden
+ *      False - Amidst override
+ * Description:
+ *      Overrides the strip with the provided RGB value, one pixel at a time.
+ */
+bool strip_override(override_state *state, RGB_t rgb, uint16_t delay)
 {
-
-        static uint16_t pos = 0;
-
-        if (pos == strip_size) {
-                pos = 0;
+        if (state->pos >= strip_size) {
+                state->pos = 0;
                 return true;
         }
 
-        if (ms_passed() < delay)
+        if (!tmr_expired(&state->tmr, delay))
                 return false;
         
+        uint8_t px[3];
+        rgb_to_wire(px, rgb);
+
         ws2812_prep_tx();        
-        for (uint16_t i = 0; i <= pos; i++) {
-                ws2812_tx_byte(rgb[WS2812_WIRING_RGB_0]);
-                ws2812_tx_byte(rgb[WS2812_WIRING_RGB_1]);
-                ws2812_tx_byte(rgb[WS2812_WIRING_RGB_2]);
-        }
+        ws2812_tx_repeat(px, sizeof(px), state->pos + 1);
         ws2812_end_tx();
 
-        pos++;
+        state->pos++;
 
-        reset_timer();
+        tmr_reset(&state->tmr);
         return false;
 }
 
-void strip_override_array(RGB_t rgb[], uint8_t size, uint16_t delay)
+/* strip_override_array
+ * --------------------
+ * Parameters:
+ *      state - Override state
+ *      rgb - Array of RGB values to override the strip with
+ *      size - Size of the RGB array
+ *      delay - Delay in ms between each overridden pixel
+ * Description:
+ *      Overrides the strip with each RGB value of the array in turn.
+ */
+void strip_override_array(override_state *state, RGB_t rgb[], uint8_t size, uint16_t delay)
+{
+        if (state->i >= size)
+                state->i = 0;
+
+        if (strip_override(state, rgb[state->i], delay))
+                state->i = (state->i + 1) % size;
+}
+
+/* strip_override_random
+ * ---------------------
+ * Parameters:
+ *      state - Override state
+ *      delay - Delay in ms between each overridden pixel
+ * Description:
+ *      Overrides the strip with random RGB values.
+ */
+void strip_override_random(override_state *state, uint16_t delay)
 {
-        static uint8_t i = 0;
+        if (strip_override(state, state->rgb, delay)) {
+                state->rgb[R] = rand() % 256;
+                state->rgb[G] = rand() % 256;
+                state->rgb[B] = rand() % 256;
+        }
+}
 
-        if (strip_override(rgb[i], delay))
-                i = (i + 1) % size;
+/* strip_override_rainbow
+ * ----------------------
+ * Parameters:
+ *      state - Override state
+ *      delay - Delay in ms between each overridden pixel
+ *      step_size - Color steps after each override
+ * Description:
+ *      Overrides the strip with the colors of the RGB spectrum.
+ */
+void strip_override_rainbow(override_rainbow_state *state, uint16_t delay, uint8_t step_size)
+{
+        if (strip_override(state, state->rgb, delay)) {
+                state->hue += step_size * HUE_STEP;
+                rgb_hue(state->hue, state->rgb);
+        }
 }
 
-void strip_override_rainbow(uint16_t delay, uint8_t step_size)
+/* strip_twinkle
+ * -------------
+ * Parameters:
+ *      state - Twinkle state
+ *      rgb - RGB value of the twinkling pixels
+ *      min_t_appart - Minimum time in ms between twinkles
+ *      max_t_appart - Maximum time in ms between twinkles
+ *      delay - Delay in ms between each fading step
+ * Description:
+ *      Lights up random pixels at full brightness, which then fade
+ *      out in 15 steps. Unlike strip_rain, there's no limit on the
+ *      number of lit pixels, as the brightness of every pixel is
+ *      held in a palette buffer, at half a byte per pixel.
+ */
+void strip_twinkle(twinkle_state *state, RGB_t rgb, uint16_t min_t_appart, uint16_t max_t_appart, uint16_t delay)
 {
-        static RGB_t rgb = {255, 0, 0};
+        palbuf *buf = &state->buf;
+
+        if (tmr_expired(&state->fade_tmr, delay)) {
+                uint16_t n = (strip_size + 1) / 2;
+
+                if (n > sizeof(buf->px))
+                        n = sizeof(buf->px);
+
+                for (uint16_t i = 0; i < n; i++) {
+                        uint8_t px = buf->px[i];
+
+                        if (px & 0x0F)
+                                px--;
+                        if (px & 0xF0)
+                                px -= 0x10;
+
+                        buf->px[i] = px;
+                }
+
+                tmr_reset(&state->fade_tmr);
+        }
+
+        if (tmr_expired(&state->twinkle_tmr, (rand() % (max_t_appart - min_t_appart + 1)) + min_t_appart)) {
+                palbuf_set(buf, rand() % strip_size, PALBUF_COLORS - 1);
+                tmr_reset(&state->twinkle_tmr);
+        }
 
-        if (strip_override(rgb, delay))
-                rgb_apply_fade(rgb, step_size);
+        palbuf_gradient(buf, (RGB_ptr_t) off, rgb);
+        strip_apply_palbuf(buf);
 }
 
 #endif
\ No newline at end of file
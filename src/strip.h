@@ -24,9 +24,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#include <avr/eeprom.h>
-
 #include "config.h"
+#include "settings.h"
+#include "timer.h"
 
 #define R 0
 #define G 1
@@ -39,15 +39,16 @@
 
 #if STRIP_TYPE == WS2812
 
-        extern uint16_t eeprom_strip_size EEMEM;
         extern uint16_t strip_size;
 
-        #define SET_STRIP_SIZE(size) eeprom_update_word(&eeprom_strip_size, size)
+        // Evaluates to the result of settings_save()
+        #define SET_STRIP_SIZE(size) \
+                (eeprom_settings.strip_size = (size), settings_save())
         
         #ifdef STRIP_SIZE
                 #define GET_STRIP_SIZE STRIP_SIZE
         #else
-                #define GET_STRIP_SIZE (eeprom_read_word(&eeprom_strip_size))
+                #define GET_STRIP_SIZE (eeprom_settings.strip_size)
         #endif
         
         #if WS2812_COLOR_ORDER == RGB
@@ -104,6 +105,15 @@
 
 #endif
 
+////////////////////////
+// Hues
+////////////////////////
+
+// 16-bit hue of a single color step, as taken by the STEP_SIZE
+// parameters of the rainbow patches. A full turn of the color
+// wheel takes roughly 765 steps.
+#define HUE_STEP 86
+
 ////////////////////////
 // Data Structures
 ////////////////////////
@@ -186,62 +196,379 @@ typedef struct pxl {
         RGB_t rgb;
 } pxl;
 
-/* pxlbuf
+/* dropset
  * ----------
  * Description:
- *      Buffer of pxl objects. Allows one to address
- *      pixels individually without having to allocate
- *      memory for unused pixels.
- *      
+ *      Set of up to DROPSET_SIZE (see config.h) pixels, as used
+ *      by the rain effect. Pixels are densely packed in no
+ *      particular order, and a side table holds the slot of the
+ *      pixel at every LED. This makes lookups, insertions and
+ *      removals O(1).
+ *
+ *      The side table costs 4 bits per LED, like a palbuf,
+ *      covering STRIP_SIZE LEDs, or 256 LEDs if no size is
+ *      configured (128 bytes). DROPSET_SIZE is thus limited to 15.
+ *      A zero initialized dropset is a valid empty set.
+ *
  *      The following helper functions should be used
- *      when working with pixel buffers:
- *      
- *              pxbuf_init
- *              pxbuf_insert
- *              pxbuf_exists
- *              pxbuf_remove
- *              pxbuf_remove_at
- *                 
- */
-typedef struct pxbuf {
-        uint16_t size;
-        pxl* buf;
-} pxbuf;
+ *      when working with droplet sets:
+ *
+ *              dropset_init
+ *              dropset_insert
+ *              dropset_exists
+ *              dropset_remove
+ */
+#ifndef DROPSET_SIZE
+#define DROPSET_SIZE 15
+#endif
+
+#if DROPSET_SIZE > 15
+#error "DROPSET_SIZE must not exceed 15"
+#endif
+
+#ifndef DROPSET_PIXELS
+#ifdef STRIP_SIZE
+#define DROPSET_PIXELS STRIP_SIZE
+#else
+#define DROPSET_PIXELS 256
+#endif
+#endif
+
+typedef struct dropset {
+        uint8_t size;                           // Number of pixels in the set
+        uint8_t slots[(DROPSET_PIXELS + 1) / 2];    // Slot + 1 of the pixel at each LED, 0 if none (4 bits per LED)
+        pxl px[DROPSET_SIZE];
+} dropset;
+
+/* palbuf
+ * ----------
+ * Description:
+ *      Framebuffer storing a 4-bit index into a palette of
+ *      PALBUF_COLORS colors per LED, two LEDs per byte (even
+ *      LEDs in the low nibble). Indices are expanded to their
+ *      colors while the frame is transmitted (see
+ *      strip_apply_palbuf), so only the palette is ever held
+ *      as full colors.
+ *
+ *      The required memory for a palette buffer is given by:
+ *
+ *              mem = PALBUF_PIXELS / 2 + PALBUF_COLORS * 3
+ *
+ *      Meaning a strip of 200 pixels takes 148 Bytes, rather than
+ *      the 600 Bytes of a RGB buffer. PALBUF_PIXELS covers STRIP_SIZE
+ *      LEDs, or 255 LEDs (the calibration limit) if no size is configured.
+ *      Pixels beyond PALBUF_PIXELS are off. A zero initialized palette
+ *      buffer is valid, with every pixel off.
+ *
+ *      The following helper functions should be used
+ *      when working with palette buffers:
+ *
+ *              palbuf_init
+ *              palbuf_set_color
+ *              palbuf_gradient
+ *              palbuf_set
+ *              palbuf_get
+ *              palbuf_fill
+ */
+#define PALBUF_COLORS 16
+
+#ifndef PALBUF_PIXELS
+#ifdef STRIP_SIZE
+#define PALBUF_PIXELS STRIP_SIZE
+#else
+#define PALBUF_PIXELS 255
+#endif
+#endif
+
+typedef struct palbuf {
+        RGB_t palette[PALBUF_COLORS];           // Palette, in the strip's color order
+        uint8_t px[(PALBUF_PIXELS + 1) / 2];    // Palette index of each LED
+} palbuf;
+
+/* rlebuf
+ * ----------
+ * Description:
+ *      Run-length encoded frame of up to RLEBUF_RUNS (see config.h)
+ *      runs of equally colored pixels, projected onto the strip in
+ *      their indexed order. Unlike the substrpbuf, a run-length buffer
+ *      holds its runs itself and thus needs no allocation, making it
+ *      suitable for the stack or a patch state.
+ *
+ *      Runs flagged with RLE_GRADIENT fade linearly from their own
+ *      color to that of the following run, which is reached at the
+ *      first pixel of the following run. Runs are expanded into the
+ *      WS2812 bitstream while the frame is transmitted (see
+ *      strip_apply_rlebuf). Colors are stored in the strip's color order.
+ *
+ *      The following helper functions should be used
+ *      when working with run-length buffers:
+ *
+ *              rlebuf_init
+ *              rlebuf_push
+ *              rlebuf_apply_brightness
+ *              rlebuf_split
+ *              rlebuf_distribute
+ *              rlebuf_calibrate
+ */
+#ifndef RLEBUF_RUNS
+#define RLEBUF_RUNS 8
+#endif
+
+#define RLE_GRADIENT 0x8000     // Length flag of runs fading into the following run
+#define RLE_LENGTH   0x7FFF     // Length mask
+
+typedef struct rlerun {
+        uint16_t length;        // Number of pixels, optionally flagged with RLE_GRADIENT
+        RGB_t rgb;              // Color, in the strip's color order
+} rlerun;
+
+typedef struct rlebuf {
+        uint8_t size;           // Number of runs
+        rlerun runs[RLEBUF_RUNS];
+} rlebuf;
+
+////////////////////////
+// Effect States
+////////////////////////
+
+// Animations keep their state in explicit state objects, rather than in
+// function local statics. Each state type comes with an init function,
+// which must be called before the state is first used. Init functions
+// expire the state's timers, so patches transmit at their first render.
+// The registry in effect.cpp places the state of all patches in one
+// shared union, see the PATCH() entries in config.h.
+
+/* rainbow_state
+ * -------------
+ * Description:
+ *      State of strip_rainbow and strip_rotate_rainbow.
+ */
+typedef struct rainbow_state {
+        uint16_t hue;                   // Current hue (see rgb_hue)
+        tmr_t tmr;
+} rainbow_state;
+
+/* fade_state
+ * ----------
+ * Description:
+ *      State of strip_fade and rgb_apply_brightness_fade.
+ */
+typedef struct fade_state {
+        RGB_t rgb_out;                  // Last applied (scaled) color
+        tmr_t tmr;
+        bool inc;                       // Brightness is increasing
+        int16_t brightness;
+} fade_state;
+
+/* breathe_state
+ * -------------
+ * Description:
+ *      State of strip_breathe and the animations built
+ *      on top of it (array, random and rainbow breathing).
+ */
+typedef struct breathe_state {
+        fade_state fade;
+        bool done;                      // Breath completed, pausing
+        tmr_t pause;
+        uint8_t i;                      // Breathed index of strip_breathe_array
+        RGB_t rgb;                      // Breathed color of strip_breathe_random/rainbow
+        uint16_t hue;                   // Breathed hue of strip_breathe_rainbow
+} breathe_state;
+
+typedef breathe_state breathe_rainbow_state;
+
+/* trigger_fade_state
+ * ------------------
+ * Description:
+ *      State of the PATCH_ANIMATION_FADE_ON_RISE patch.
+ */
+typedef struct trigger_fade_state {
+        fade_state fade;
+        bool prev_trigger;
+        bool done;                      // Fade completed, awaiting next trigger
+} trigger_fade_state;
+
+/* rain_state
+ * ----------
+ * Description:
+ *      State of strip_rain.
+ */
+typedef struct rain_state {
+        dropset drops;
+        tmr_t fade_tmr;
+        tmr_t drop_tmr;
+} rain_state;
+
+/* override_state
+ * --------------
+ * Description:
+ *      State of strip_override and the animations
+ *      built on top of it.
+ */
+typedef struct override_state {
+        uint16_t pos;                   // Number of overridden pixels
+        tmr_t tmr;
+        uint8_t i;                      // Current index of strip_override_array
+        RGB_t rgb;                      // Current color of the random and rainbow overrides
+        uint16_t hue;                   // Current hue of the rainbow override
+} override_state;
+
+typedef override_state override_rainbow_state;
+
+/* swap_state
+ * ----------
+ * Description:
+ *      State of the swap and toggle patches.
+ */
+typedef struct swap_state {
+        bool swap;
+        bool prev_trigger;
+        tmr_t tmr;
+} swap_state;
+
+/* move_div_state
+ * --------------
+ * Description:
+ *      State of the PATCH_ANIMATION_MOVE_DIV_ON_RISE patch.
+ *      The substrips are set up by the patch itself on its
+ *      first call, as their lengths depend on its parameters.
+ */
+typedef struct move_div_state {
+        bool ready;
+        bool prev_trigger;
+        int16_t remaining;
+        substrp substrps[3];
+} move_div_state;
+
+/* twinkle_state
+ * -------------
+ * Description:
+ *      State of strip_twinkle. Each pixel of the buffer holds
+ *      the brightness level of the pixel, the palette being a
+ *      gradient from off to the twinkled color.
+ */
+typedef struct twinkle_state {
+        palbuf buf;
+        tmr_t fade_tmr;
+        tmr_t twinkle_tmr;
+} twinkle_state;
+
+/* pixel_fn
+ * --------
+ * Description:
+ *      Procedural pixel function of a patch. Writes the color
+ *      of the pixel at the provided index into rgb, without
+ *      transmitting anything. The color may only depend on
+ *      the index and the state, so that a frame never has
+ *      to be buffered (see strip_apply_pixels).
+ */
+typedef void (*pixel_fn)(void *state, uint16_t index, RGB_ptr_t rgb);
+
+/* pixel_state
+ * -----------
+ * Description:
+ *      State of procedural patches (see PIXEL_PATCH() in config.h).
+ *      The animation time t counts the frames rendered since
+ *      the patch has been selected.
+ */
+typedef struct pixel_state {
+        uint16_t t;
+        tmr_t tmr;
+} pixel_state;
+
+void rainbow_init(rainbow_state *state);
+void fade_init(fade_state *state);
+void breathe_init(breathe_state *state);
+void breathe_rainbow_init(breathe_rainbow_state *state);
+void trigger_fade_init(trigger_fade_state *state);
+void rain_init(rain_state *state);
+void override_init(override_state *state);
+void override_rainbow_init(override_rainbow_state *state);
+void swap_init(swap_state *state);
+void move_div_init(move_div_state *state);
+void twinkle_init(twinkle_state *state);
+void pixel_init(pixel_state *state);
 
 void rgb_apply_brightness(RGB_t rgb, uint8_t brightness);
+void rgb_hue_spectrum(uint16_t hue, RGB_ptr_t rgb);
+void rgb_hue_rainbow(uint16_t hue, RGB_ptr_t rgb);
+
+/* rgb_hue
+ * -------
+ * Parameters:
+ *      hue - 16-bit hue, running from red (0) around the color
+ *            wheel and back to red (65535). The upper byte alone
+ *            forms an 8-bit hue.
+ *      rgb - RGB object to store the color
+ * Description:
+ *      Maps a hue to a fully saturated color on the color wheel
+ *      selected in the config (see HUE_RAINBOW), in constant time
+ *      and without divisions. Hues wrap around, hence they may be
+ *      added to, subtracted from and interpolated freely.
+ */
+static inline void rgb_hue(uint16_t hue, RGB_ptr_t rgb)
+{
+#ifdef HUE_RAINBOW
+        rgb_hue_rainbow(hue, rgb);
+#else
+        rgb_hue_spectrum(hue, rgb);
+#endif
+}
+
 void substripbuf_apply_brightness(substrpbuf *strp, uint8_t brightness);
 
 void substrpbuf_cpy(substrpbuf *dst, substrpbuf *src);
 void substrpbuf_free(substrpbuf *strp);
 
-void pxbuf_init(pxbuf *buf);
-void pxbuf_insert(pxbuf *buf, uint16_t pos, RGB_t rgb);
-bool pxbuf_exists(pxbuf *buf, uint16_t pos);
-void pxbuf_remove(pxbuf *buf, uint16_t index);
-bool pxbuf_remove_at(pxbuf *buf, uint16_t pos);
+void dropset_init(dropset *set);
+bool dropset_insert(dropset *set, uint16_t pos, RGB_t rgb);
+bool dropset_exists(dropset *set, uint16_t pos);
+void dropset_remove(dropset *set, uint8_t slot);
+
+void palbuf_init(palbuf *buf);
+void palbuf_set_color(palbuf *buf, uint8_t index, RGB_t rgb);
+void palbuf_gradient(palbuf *buf, RGB_t from, RGB_t to);
+void palbuf_set(palbuf *buf, uint16_t pos, uint8_t index);
+uint8_t palbuf_get(palbuf *buf, uint16_t pos);
+void palbuf_fill(palbuf *buf, uint8_t index);
+
+void rlebuf_init(rlebuf *buf);
+bool rlebuf_push(rlebuf *buf, uint16_t length, RGB_t rgb, bool gradient);
+void rlebuf_apply_brightness(rlebuf *buf, uint8_t brightness);
+void rlebuf_split(rlebuf *buf, RGB_t first, RGB_t second, uint16_t split);
+void rlebuf_distribute(rlebuf *buf, RGB_t rgb[], uint8_t size, bool gradient);
+void rlebuf_calibrate(rlebuf *buf, uint8_t end);
 
 void strip_apply_all(RGB_ptr_t rgb);
+void strip_apply_pixels(void *state, pixel_fn pixel);
+void strip_pixels(pixel_state *state, pixel_fn pixel, uint16_t delay_ms);
 
 #if STRIP_TYPE == WS2812
 void strip_calibrate();
 void strip_apply_substrpbuf(substrpbuf strp);
 void strip_apply_RGBbuf(RGBbuf RGBbuf);
-void strip_apply_pxbuf(pxbuf *buf);
+void strip_apply_dropset(dropset *set);
+void strip_apply_palbuf(palbuf *buf);
+void strip_apply_rlebuf(rlebuf *buf);
 void strip_distribute_rgb(RGB_t rgb[], uint16_t size);
+void strip_gradient_rgb(RGB_t rgb[], uint16_t size);
 #endif
 
 void strip_scroll_rgb(uint16_t val, uint8_t brightness);
-bool strip_fade(RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size, bool start);
-bool strip_breathe(RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size);
-void strip_breathe_array(RGB_t rgb[], uint8_t size, uint16_t delay_ms, uint8_t step_size);
-void strip_breathe_random(uint16_t delay_ms, uint8_t step_size);
-void strip_breathe_rainbow(uint16_t delay_ms, uint8_t breath_step_size, uint8_t rgb_step_size);
-void strip_rainbow(uint8_t step_size, uint16_t delay, uint8_t brightness);
+bool rgb_apply_brightness_fade(fade_state *state, RGB_ptr_t rgb_in, RGB_ptr_t rgb_out, uint16_t step_size, bool start);
+bool strip_fade(fade_state *state, RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size, bool start);
+bool strip_breathe(breathe_state *state, RGB_ptr_t rgb, uint16_t delay_ms, uint8_t step_size);
+void strip_breathe_array(breathe_state *state, RGB_t rgb[], uint8_t size, uint16_t delay_ms, uint8_t step_size);
+void strip_breathe_random(breathe_state *state, uint16_t delay_ms, uint8_t step_size);
+void strip_breathe_rainbow(breathe_rainbow_state *state, uint16_t delay_ms, uint8_t breath_step_size, uint8_t rgb_step_size);
+void strip_rainbow(rainbow_state *state, uint8_t step_size, uint16_t delay, uint8_t brightness);
 
 #if STRIP_TYPE == WS2812
-void strip_rotate_rainbow(uint8_t step_size, uint16_t delay_ms);
-void strip_rain(RGB_t rgb, uint16_t max_drops, uint16_t min_t_appart, uint16_t max_t_appart, uint16_t delay);
-bool strip_override(RGB_t rgb, uint16_t delay);
-void strip_override_array(RGB_t rgb[], uint8_t size, uint16_t delay);
-void strip_override_rainbow(uint16_t delay, uint8_t step_size);
-#endif
\ No newline at end of file
+void strip_rotate_rainbow(rainbow_state *state, uint8_t step_size, uint16_t delay_ms);
+void strip_rain(rain_state *state, RGB_t rgb, uint16_t max_drops, uint16_t min_t_appart, uint16_t max_t_appart, uint16_t delay);
+bool strip_override(override_state *state, RGB_t rgb, uint16_t delay);
+void strip_override_array(override_state *state, RGB_t rgb[], uint8_t size, uint16_t delay);
+void strip_override_random(override_state *state, uint16_t delay);
+void strip_override_rainbow(override_rainbow_state *state, uint16_t delay, uint8_t step_size);
+void strip_twinkle(twinkle_state *state, RGB_t rgb, uint16_t min_t_appart, uint16_t max_t_appart, uint16_t delay);
+#endif
@@ -0,0 +1,99 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   * 
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Defines timing related functions.
+   * 
+   */
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#ifdef ARDUINO_BUILD
+#include <Arduino.h>
+#endif
+
+#ifdef NATIVE_BUILD
+#include "hal/native/native.h"
+#else
+#include <util/atomic.h>
+#endif
+
+#include "config.h"
+#include "timer.h"
+
+#if !defined(ARDUINO_BUILD) && !defined(NATIVE_BUILD)
+
+// Interrupt controlled
+volatile unsigned long timer_ms = 0; // Milliseconds passed since boot
+
+#if STRIP_TYPE == WS2812
+
+/* ISR(TIMER0_COMPA_vect)
+ * ----------------------
+ * Description:
+ *      Timer0 runs in CTC mode with a prescaler of 64,
+ *      causing a compare match every millisecond.
+ */
+ISR(TIMER0_COMPA_vect)
+{
+        timer_ms++;
+}
+
+#else
+
+/* ISR(TIMER1_OVF_vect)
+ * --------------------
+ * Description:
+ *      Timer0 generates the PWM signals for non-addressable
+ *      strips and runs unprescaled, leaving the millisecond
+ *      tick to Timer1. Timer1 runs with a prescaler of 64
+ *      and a top of TMR_CTC_TOP, overflowing every millisecond.
+ *      As Timer1 can't auto trigger the ADC, the conversions
+ *      of the background sampler, which enables the ADC
+ *      interrupt while running, are started here.
+ */
+ISR(TIMER1_OVF_vect)
+{
+        timer_ms++;
+
+        // Leave ADIF untouched, as writing it clears it
+        if (ADCSRA & (1 << ADIE))
+                ADCSRA = (ADCSRA & ~(1 << ADIF)) | (1 << ADSC);
+}
+
+#endif
+
+/* millis
+ * ------
+ * Returns:
+ *      Milliseconds passed since boot
+ * Description:
+ *      Atomically reads the millisecond counter.
+ */
+unsigned long millis()
+{
+        unsigned long ms;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                ms = timer_ms;
+        }
+
+        return ms;
+}
+
+#endif
@@ -0,0 +1,162 @@
+  /*
+   * Copyright (C) 2020  Patrick Pedersen
+
+   * This program is free software: you can redistribute it and/or modify
+   * it under the terms of the GNU General Public License as published by
+   * the Free Software Foundation, either version 3 of the License, or
+   * (at your option) any later version.
+
+   * This program is distributed in the hope that it will be useful,
+   * but WITHOUT ANY WARRANTY; without even the implied warranty of
+   * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   * GNU General Public License for more details.
+
+   * You should have received a copy of the GNU General Public License
+   * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+   * 
+   * Author: Patrick Pedersen <ctx.xda@gmail.com>
+   * Description: Exposes timing related functions.
+   * 
+   */
+
+#pragma once
+
+#include <stdbool.h>
+
+#include <avr/io.h>
+
+#include "config.h"
+
+#ifdef ARDUINO_BUILD
+#include <Arduino.h>
+#define DELAY_MS(ms) delay(ms)
+#else
+#include <util/delay.h>
+#define DELAY_MS(ms) _delay_ms(ms)
+#endif
+
+#define TMR_PRESCALER 64
+#define TMR_CTC_TOP ((F_CPU / TMR_PRESCALER / 1000) - 1) // Timer0 (Timer1 on non-addressable strips) top value for a 1 ms tick
+
+#if defined(__AVR_ATmega328__) || defined(__AVR_ATmega328P__)
+#define TMR_TIMSK TIMSK0
+#define TMR_TIFR TIFR0
+#else
+#define TMR_TIMSK TIMSK
+#define TMR_TIFR TIFR
+#endif
+
+/* TMR_POLL
+ * --------
+ * Description:
+ *      Accounts for a pending millisecond tick while interrupts
+ *      are disabled. Timer0 only latches a single compare match,
+ *      meaning any further ticks during long, interrupt free
+ *      sections (ex. WS2812 transmissions) would otherwise be lost.
+ *      Must only be used with interrupts disabled. Expands to
+ *      nothing where the timebase is not driven by our own ISR.
+ */
+#if !defined(ARDUINO_BUILD) && !defined(NATIVE_BUILD) && STRIP_TYPE == WS2812
+extern volatile unsigned long timer_ms;
+
+#define TMR_POLL() \
+        if (TMR_TIFR & (1 << OCF0A)) { \
+                TMR_TIFR = (1 << OCF0A); \
+                timer_ms++; \
+        }
+#else
+#define TMR_POLL()
+#endif
+
+#ifndef ARDUINO_BUILD
+unsigned long millis();
+#endif
+
+/* tmr_t
+ * -----
+ * Description:
+ *      Lightweight timer handle. Every consumer of time (effects,
+ *      input handling, ...) owns its own handle, all of which run off
+ *      the single free running millisecond counter. All comparisons
+ *      are done on the difference to the counter, meaning timers remain
+ *      correct when the counter wraps around (every ~49 days).
+ *
+ *      The following helper functions should be used
+ *      when working with timers:
+ *
+ *              tmr_reset
+ *              tmr_expire
+ *              tmr_elapsed
+ *              tmr_expired
+ *              tmr_advance
+ */
+typedef struct tmr_t {
+        unsigned long start;
+} tmr_t;
+
+/* tmr_reset
+ * ---------
+ * Parameters:
+ *      tmr - Pointer to a timer
+ * Description:
+ *      Restarts the timer.
+ */
+static inline void tmr_reset(tmr_t *tmr)
+{
+        tmr->start = millis();
+}
+
+/* tmr_expire
+ * ----------
+ * Parameters:
+ *      tmr - Pointer to a timer
+ * Description:
+ *      Sets the timer's start back by 65536 ms, meaning any
+ *      16-bit timeout has already expired. Used to have a
+ *      periodic event fire at its first poll.
+ */
+static inline void tmr_expire(tmr_t *tmr)
+{
+        tmr->start = millis() - 0x10000UL;
+}
+
+/* tmr_elapsed
+ * -----------
+ * Parameters:
+ *      tmr - Pointer to a timer
+ * Returns:
+ *      Milliseconds passed since the timer has been reset
+ */
+static inline unsigned long tmr_elapsed(tmr_t *tmr)
+{
+        return millis() - tmr->start;
+}
+
+/* tmr_expired
+ * -----------
+ * Parameters:
+ *      tmr - Pointer to a timer
+ *      ms - Timeout in ms
+ * Returns:
+ *      Whether the deadline of ms after the last reset has passed
+ */
+static inline bool tmr_expired(tmr_t *tmr, unsigned long ms)
+{
+        return millis() - tmr->start >= ms;
+}
+
+/* tmr_advance
+ * -----------
+ * Parameters:
+ *      tmr - Pointer to a timer
+ *      ms - Period in ms
+ * Description:
+ *      Moves the timer's start forward by one period. Unlike
+ *      tmr_reset(), this doesn't accumulate the latency with which
+ *      an expired timer has been noticed, allowing for drift free
+ *      periodic events.
+ */
+static inline void tmr_advance(tmr_t *tmr, unsigned long ms)
+{
+        tmr->start += ms;
+}
\ No newline at end of file
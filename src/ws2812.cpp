@@ -9,13 +9,233 @@
 
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "config.h"
 #include "ws2812.h"
- 
+#include "timer.h"
+
 #if STRIP_TYPE == WS2812
 
+#ifdef WS2812_GAMMA
+#ifdef WS2812_DITHER
+// round(0xFF00 * (i / 255)^2.8), 8.8 fixed point
+const uint16_t ws2812_gamma[256] PROGMEM = {
+            0,     0,     0,     0,     1,     1,     2,     3,
+            4,     6,     8,    10,    13,    16,    19,    23,
+           28,    33,    39,    45,    52,    60,    68,    78,
+           87,    98,   109,   121,   134,   148,   163,   179,
+          195,   213,   232,   251,   272,   293,   316,   340,
+          365,   391,   418,   447,   477,   508,   540,   573,
+          608,   644,   682,   721,   761,   802,   846,   890,
+          936,   984,  1033,  1084,  1136,  1190,  1245,  1302,
+         1361,  1421,  1483,  1547,  1612,  1680,  1749,  1820,
+         1892,  1967,  2043,  2121,  2202,  2284,  2368,  2454,
+         2542,  2632,  2724,  2818,  2914,  3012,  3112,  3215,
+         3319,  3426,  3535,  3646,  3759,  3875,  3992,  4112,
+         4235,  4359,  4486,  4616,  4748,  4882,  5018,  5157,
+         5299,  5442,  5589,  5738,  5889,  6043,  6200,  6359,
+         6520,  6685,  6852,  7021,  7194,  7369,  7546,  7727,
+         7910,  8096,  8285,  8476,  8671,  8868,  9068,  9271,
+         9477,  9685,  9897, 10112, 10329, 10550, 10774, 11000,
+        11230, 11463, 11698, 11937, 12179, 12425, 12673, 12924,
+        13179, 13437, 13698, 13962, 14230, 14501, 14775, 15052,
+        15333, 15617, 15905, 16196, 16490, 16788, 17089, 17393,
+        17701, 18013, 18328, 18646, 18968, 19294, 19623, 19956,
+        20292, 20632, 20976, 21323, 21674, 22029, 22387, 22750,
+        23115, 23485, 23859, 24236, 24617, 25002, 25390, 25783,
+        26179, 26580, 26984, 27392, 27804, 28220, 28640, 29064,
+        29492, 29925, 30361, 30801, 31245, 31694, 32146, 32603,
+        33064, 33529, 33998, 34471, 34949, 35431, 35917, 36407,
+        36902, 37400, 37904, 38411, 38923, 39439, 39960, 40485,
+        41015, 41548, 42087, 42630, 43177, 43729, 44285, 44846,
+        45411, 45981, 46556, 47135, 47718, 48307, 48900, 49497,
+        50100, 50707, 51318, 51935, 52556, 53182, 53812, 54448,
+        55088, 55733, 56383, 57038, 57698, 58362, 59032, 59706,
+        60385, 61070, 61759, 62453, 63152, 63856, 64566, 65280
+};
+#else
+// round(255 * (i / 255)^2.8)
+const uint8_t ws2812_gamma[256] PROGMEM = {
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+          0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+          1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+          2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+          5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+         10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+         17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+         25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+         37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+         51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+         69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+         90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+        115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+        144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+        177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+        215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255
+};
+#endif
+#endif
+
+// Incremented with every frame transmitted to the strip, and whenever the
+// strip has to be refreshed for other reasons. Callers skipping redundant
+// frames compare it to its value right after their own last transmission,
+// any difference meaning the strip may no longer show their frame.
+uint16_t ws2812_seq = 0;
+
+#ifdef WS2812_DITHER
+uint8_t ws2812_dither = 0;
+uint8_t ws2812_residual = 0;
+bool ws2812_dithering = false;
+static uint8_t _dither_frame = 0;
+
+/* ws2812_dither_end
+ * -----------------
+ * Description:
+ *      Called by ws2812_end_tx() after a frame has been transmitted
+ *      to the strip. Notes whether the frame left any residual to
+ *      be dithered, and advances the threshold for the next frame.
+ *      Thresholds follow the bit reversed frame count, spreading
+ *      them evenly over any run of successive frames.
+ */
+void ws2812_dither_end()
+{
+        uint8_t frame = ++_dither_frame;
+        uint8_t dither = 0;
+
+        for (uint8_t i = 0; i < 8; i++) {
+                dither = (dither << 1) | (frame & 1);
+                frame >>= 1;
+        }
+
+        ws2812_dithering = (ws2812_residual != 0);
+        ws2812_residual = 0;
+        ws2812_dither = dither;
+}
+#endif
+
+#ifdef WS2812_MASTER_BRIGHTNESS
+uint8_t ws2812_brightness = WS2812_MASTER_BRIGHTNESS;
+
+/* ws2812_set_brightness
+ * ---------------------
+ * Parameters:
+ *      brightness - Master brightness (0 = 0%, 255 = 100%)
+ * Description:
+ *      Sets the brightness applied to every byte transmitted to the
+ *      strip, on top of whatever brightness the patch applies itself.
+ */
+void ws2812_set_brightness(uint8_t brightness)
+{
+        if (brightness != ws2812_brightness)
+                ws2812_seq++;
+
+        ws2812_brightness = brightness;
+}
+#endif
+
+#ifdef WS2812_CAPTURE
+uint8_t *ws2812_capture_buf = NULL;
+bool ws2812_capture_tee = false;        // Transmissions reach the strip while captured
+static uint16_t _capture_len, _capture_pos;
+static bool _capture_done;
+
+/* ws2812_capture_start
+ * --------------------
+ * Parameters:
+ *      buf - Buffer receiving the captured frame
+ *      len - Size of the buffer in bytes
+ * Description:
+ *      Redirects all following transmissions into the provided
+ *      buffer instead of the strip, until ws2812_capture_stop()
+ *      is called. Bytes are stored as provided by the patch, in
+ *      the strip's color order, without brightness or gamma
+ *      correction. Bytes exceeding the buffer are dropped.
+ */
+void ws2812_capture_start(uint8_t *buf, uint16_t len)
+{
+        ws2812_capture_buf = buf;
+        ws2812_capture_tee = false;
+        _capture_len = len;
+        _capture_pos = 0;
+        _capture_done = false;
+}
+
+/* ws2812_record_start
+ * -------------------
+ * Parameters:
+ *      buf - Buffer receiving the transmitted frame
+ *      len - Size of the buffer in bytes
+ * Description:
+ *      Same as ws2812_capture_start(), except that transmissions
+ *      still reach the strip. The buffer thereby keeps a copy of
+ *      the frame shown on the strip, without the frame having to
+ *      be transmitted from the buffer again.
+ */
+void ws2812_record_start(uint8_t *buf, uint16_t len)
+{
+        ws2812_capture_start(buf, len);
+        ws2812_capture_tee = true;
+}
+
+/* ws2812_capture_stop
+ * -------------------
+ * Returns:
+ *      True if at least one frame has been completed
+ *      since ws2812_capture_start() was called
+ * Description:
+ *      Ends the capture or recording, transmissions
+ *      only go to the strip again.
+ */
+bool ws2812_capture_stop()
+{
+        ws2812_capture_buf = NULL;
+        ws2812_capture_tee = false;
+        return _capture_done;
+}
+
+/* ws2812_capture_prep
+ * -------------------
+ * Description:
+ *      Called by ws2812_prep_tx() while capturing.
+ *      A new frame overwrites the buffer from the start.
+ */
+void ws2812_capture_prep()
+{
+        _capture_pos = 0;
+}
+
+/* ws2812_capture_end
+ * ------------------
+ * Description:
+ *      Called by ws2812_end_tx() while capturing.
+ */
+void ws2812_capture_end()
+{
+        _capture_done = true;
+}
+
+/* ws2812_capture_tx
+ * -----------------
+ * Parameters:
+ *      buf - Bytes to be captured
+ *      len - Number of bytes
+ * Description:
+ *      Called by the transmit routines while capturing.
+ */
+void ws2812_capture_tx(const uint8_t *buf, uint16_t len)
+{
+        while (len-- && _capture_pos < _capture_len)
+                ws2812_capture_buf[_capture_pos++] = *buf++;
+}
+#endif
+
+#endif
+
+// Native builds provide their own implementation (see hal/native)
+#if STRIP_TYPE == WS2812 && !defined(NATIVE_BUILD)
+
 /*
   This routine writes an array of bytes with RGB values to the Dataout pin
   using the fast 800kHz clockless WS2811/2812 protocol.
@@ -83,10 +303,19 @@ static uint8_t _sreg_prev, _maskhi, _masklo;
  * --------------
  * Description:
  *      Prepares for a data transmission to the WS2812 strip.
- *      Always call this function before calling ws2812_tx_byte()!
+ *      Always call this function before calling ws2812_tx_buffer()
+ *      or ws2812_tx_repeat()!
  */
 void ws2812_prep_tx()
 {
+#ifdef WS2812_CAPTURE
+        if (WS2812_CAPTURING) {
+                ws2812_capture_prep();
+                if (!ws2812_capture_tee)
+                        return;
+        }
+#endif
+
         _masklo = ~WS2812_DIN_MSK & WS2812_DIN_PORT;
         _maskhi = WS2812_DIN_MSK | WS2812_DIN_PORT;
 
@@ -116,26 +345,38 @@ void ws2812_wait_rst()
  */
 void ws2812_end_tx()
 {
+#ifdef WS2812_CAPTURE
+        if (WS2812_CAPTURING) {
+                ws2812_capture_end();
+                if (!ws2812_capture_tee)
+                        return;
+        }
+#endif
+
+        TMR_POLL();
         SREG=_sreg_prev;
         ws2812_wait_rst();
         sei();
+
+        ws2812_seq++;
+#ifdef WS2812_DITHER
+        ws2812_dither_end();
+#endif
 }
 
-/* ws2812_tx_byte
- * --------------
+/* ws2812_tx
+ * ---------
+ * Parameters:
+ *      data - Byte to be transmitted
+ *      maskhi - Port value for a high DIN pin
+ *      masklo - Port value for a low DIN pin
  * Description:
- *      Transmitts a byte of data to the WS2812.
- *      Toggling this function three times consecutively, sets a pixel.
- *      After every third consecutive transmission, the next pixel is
- *      written to. Transmissions MUST take place consecutively, else
- *      there's a risk that the timing fails and the strip will either
- *      be written to incorrectly, or not be written to at all.
+ *      Bit-banging core shared by all transmit routines.
+ *      Always inlined, allowing callers to keep the port
+ *      address and masks in registers between bytes.
  */
-
-#pragma GCC push_options
-#pragma GCC optimize ("O0")
-
-void ws2812_tx_byte(uint8_t data)
+static inline void ws2812_tx(uint8_t data, uint8_t maskhi, uint8_t masklo) __attribute__((always_inline));
+static inline void ws2812_tx(uint8_t data, uint8_t maskhi, uint8_t masklo)
 {
         uint8_t ctr;
 
@@ -197,11 +438,74 @@ void ws2812_tx_byte(uint8_t data)
                 #endif
                 "       dec   %0    \n\t"    //  '1' [+4] '0' [+3]
                 "       brne  loop%=\n\t"    //  '1' [+5] '0' [+4]
-                :	"=&d" (ctr)
-                :	"r" (data), "x" ((uint8_t *) &WS2812_DIN_PORT), "r" (_maskhi), "r" (_masklo)
+                :	"=&d" (ctr), "+r" (data)
+                :	"x" ((uint8_t *) &WS2812_DIN_PORT), "r" (maskhi), "r" (masklo)
         );
 }
 
-#pragma GCC pop_options
+/* ws2812_tx_buffer
+ * ----------------
+ * Parameters:
+ *      buf - Bytes to be transmitted, in the strip's color order
+ *      len - Number of bytes to be transmitted
+ * Description:
+ *      Streams a contiguous buffer to the WS2812. The buffer pointer
+ *      and port masks stay in registers for the entire transmission,
+ *      keeping the gap between bytes minimal and constant. Frames
+ *      computed on the fly are transmitted pixel by pixel, by passing
+ *      one pixel at a time.
+ *      Must be enclosed by ws2812_prep_tx() and ws2812_end_tx().
+ */
+void ws2812_tx_buffer(const uint8_t *buf, uint16_t len)
+{
+#ifdef WS2812_CAPTURE
+        if (WS2812_CAPTURING) {
+                ws2812_capture_tx(buf, len);
+                if (!ws2812_capture_tee)
+                        return;
+        }
+#endif
+
+        uint8_t maskhi = _maskhi;
+        uint8_t masklo = _masklo;
+
+        while (len--) {
+                ws2812_tx(ws2812_correct(*buf++), maskhi, masklo);
+                TMR_POLL();
+        }
+}
+
+/* ws2812_tx_repeat
+ * ----------------
+ * Parameters:
+ *      buf - Bytes to be transmitted, in the strip's color order
+ *      len - Number of bytes in the buffer
+ *      n - Number of times the buffer is transmitted
+ * Description:
+ *      Same as ws2812_tx_buffer(), except that the buffer is
+ *      transmitted n times in a row. Typically used to set
+ *      a run of pixels to the same color.
+ *      Must be enclosed by ws2812_prep_tx() and ws2812_end_tx().
+ */
+void ws2812_tx_repeat(const uint8_t *buf, uint8_t len, uint16_t n)
+{
+#ifdef WS2812_CAPTURE
+        if (WS2812_CAPTURING) {
+                for (uint16_t i = 0; i < n; i++)
+                        ws2812_capture_tx(buf, len);
+                if (!ws2812_capture_tee)
+                        return;
+        }
+#endif
+
+        uint8_t maskhi = _maskhi;
+        uint8_t masklo = _masklo;
+
+        while (n--) {
+                for (uint8_t i = 0; i < len; i++)
+                        ws2812_tx(ws2812_correct(buf[i]), maskhi, masklo);
+                TMR_POLL();
+        }
+}
 
 #endif
\ No newline at end of file
@@ -12,6 +12,10 @@
 #include "config.h"
 #include "stdint.h"
 
+#include <avr/pgmspace.h>
+
+#include "color.h"
+
 #if STRIP_TYPE == WS2812 
 
 #ifdef ARDUINO_BUILD
@@ -22,9 +26,122 @@
 #define WS2812_DIN_MSK (1 << WS2812_DIN)
 #endif
 
+// Uncorrected values have no residual to dither
+#if defined(WS2812_DITHER) && !defined(WS2812_GAMMA) && !defined(WS2812_MASTER_BRIGHTNESS)
+#undef WS2812_DITHER
+#endif
+
+#ifdef WS2812_GAMMA
+#ifdef WS2812_DITHER
+extern const uint16_t ws2812_gamma[256] PROGMEM;
+#else
+extern const uint8_t ws2812_gamma[256] PROGMEM;
+#endif
+#endif
+
+#ifdef WS2812_MASTER_BRIGHTNESS
+extern uint8_t ws2812_brightness;
+void ws2812_set_brightness(uint8_t brightness);
+#endif
+
+#ifdef WS2812_DITHER
+extern uint8_t ws2812_dither;           // Dither threshold of the frame being transmitted
+extern uint8_t ws2812_residual;         // Nonzero if the frame being transmitted has a residual
+extern bool ws2812_dithering;           // True if the last frame left a residual
+void ws2812_dither_end();
+
+/* WS2812_DITHERING
+ * ----------------
+ * Description:
+ *      True while the frame on the strip relies on being
+ *      retransmitted to dither its residual. Callers skipping
+ *      redundant frames must keep transmitting meanwhile.
+ */
+#define WS2812_DITHERING ws2812_dithering
+#else
+#define WS2812_DITHERING false
+#endif
+
+/* ws2812_correct
+ * --------------
+ * Parameters:
+ *      data - Color value as provided by the patch
+ * Returns:
+ *      Color value to be put on the wire
+ * Description:
+ *      Applies the master brightness and gamma correction, if enabled
+ *      in the config. Called by the transmit routines for every byte,
+ *      compiles down to nothing if neither is enabled.
+ *
+ *      With WS2812_DITHER, the corrected value is kept in 8.8 fixed
+ *      point and rounded by the threshold of the current frame, which
+ *      changes from frame to frame. Averaged over successive frames,
+ *      the LED thereby shows the fractional value, rather than the
+ *      nearest of the 256 steps the WS2812 provides.
+ */
+static inline uint8_t ws2812_correct(uint8_t data)
+{
+#ifdef WS2812_DITHER
+        uint16_t v;
+
+#if defined(WS2812_GAMMA) && defined(WS2812_MASTER_BRIGHTNESS)
+        v = pgm_read_word(&ws2812_gamma[scale8(data, ws2812_brightness)]);
+#elif defined(WS2812_GAMMA)
+        v = pgm_read_word(&ws2812_gamma[data]);
+#else
+        v = (uint16_t)data * ws2812_brightness;
+        v += (v + 255) >> 8;    // * 256 / 255, 0xFF00 at full scale
+#endif
+
+        // At most 0xFF00, the threshold can't overflow it
+        ws2812_residual |= (uint8_t)v;
+        return (v + ws2812_dither) >> 8;
+#else
+#ifdef WS2812_MASTER_BRIGHTNESS
+        data = scale8(data, ws2812_brightness);
+#endif
+#ifdef WS2812_GAMMA
+        data = pgm_read_byte(&ws2812_gamma[data]);
+#endif
+        return data;
+#endif
+}
+
+extern uint16_t ws2812_seq;
+
+// Frame capture is only required by patch transitions
+#if defined(TRANSITION_TIME_MS) && TRANSITION_TIME_MS > 0
+#define WS2812_CAPTURE
+#endif
+
+#ifdef WS2812_CAPTURE
+extern uint8_t *ws2812_capture_buf;
+extern bool ws2812_capture_tee;
+
+/* WS2812_CAPTURING
+ * ----------------
+ * Description:
+ *      True while transmissions are stored in a capture buffer
+ *      (see ws2812_capture_start() and ws2812_record_start()).
+ *      Unless ws2812_capture_tee is set, they don't reach
+ *      the strip meanwhile.
+ */
+#define WS2812_CAPTURING (ws2812_capture_buf != NULL)
+
+void ws2812_capture_start(uint8_t *buf, uint16_t len);
+void ws2812_record_start(uint8_t *buf, uint16_t len);
+bool ws2812_capture_stop();
+void ws2812_capture_prep();
+void ws2812_capture_end();
+void ws2812_capture_tx(const uint8_t *buf, uint16_t len);
+#else
+#define WS2812_CAPTURING false
+#endif
+
 void ws2812_prep_tx();
 void ws2812_wait_rst();
-void ws2812_tx_byte(uint8_t byte);
+void ws2812_tx_buffer(const uint8_t *buf, uint16_t len);
+void ws2812_tx_repeat(const uint8_t *buf, uint8_t len, uint16_t n);
 void ws2812_end_tx();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Tests the exponential moving average of the
+ *              background ADC sampler on the CV input.
+ *
+ */
+
+#include <stdint.h>
+#include <math.h>
+
+#include <avr/io.h>
+#include <unity.h>
+
+#include "config.h"
+#include "input.h"
+#include "hal/native/native.h"
+
+// Mirrors the default of input.cpp
+#ifndef ADC_FILTER_SHIFT
+#define ADC_FILTER_SHIFT 4
+#endif
+
+#define MUX_MSK ((1 << MUX3) | (1 << MUX2) | (1 << MUX1) | (1 << MUX0))
+
+// Completed conversion interrupt of the sampler
+void ADC_vect(void);
+
+/* sample
+ * ------
+ * Parameters:
+ *      value - ADC reading
+ *      n - Number of conversions
+ * Description:
+ *      Completes n conversions of the given reading.
+ */
+static void sample(uint8_t value, uint16_t n)
+{
+        while (n--) {
+                ADCH = value;
+                ADC_vect();
+        }
+}
+
+void setUp()
+{
+        native_reset();
+        ADCH = 200;
+        adc_sampler_start();
+}
+
+void tearDown() {}
+
+/* test_adc_seed
+ * -------------
+ * Description:
+ *      The filter is seeded with a blocking conversion, meaning
+ *      the first reading is that of the input, rather than zero.
+ */
+void test_adc_seed()
+{
+        TEST_ASSERT_EQUAL(200, cv());
+        TEST_ASSERT_EQUAL(CV_INPUT_ADMUX_MSK, ADMUX & MUX_MSK);
+}
+
+/* test_adc_step
+ * -------------
+ * Description:
+ *      A step of the input is followed like a floating point EMA
+ *      spanning 2^ADC_FILTER_SHIFT samples, without overshooting.
+ */
+void test_adc_step()
+{
+        float ema = 200;
+        uint8_t prev = cv();
+
+        for (uint8_t i = 0; i < 4 << ADC_FILTER_SHIFT; i++) {
+                sample(10, 1);
+                ema += (10 - ema) / (1 << ADC_FILTER_SHIFT);
+
+                TEST_ASSERT_INT_WITHIN(1, (int)roundf(ema), cv());
+                TEST_ASSERT_LESS_OR_EQUAL(prev, cv());
+                TEST_ASSERT_GREATER_OR_EQUAL(10, cv());
+                prev = cv();
+        }
+}
+
+/* test_adc_settle
+ * ---------------
+ * Description:
+ *      The filter settles exactly on constant inputs,
+ *      including the extremes.
+ */
+void test_adc_settle()
+{
+        const uint8_t values[] = {10, 255, 0, 128, 1, 254};
+
+        for (uint8_t i = 0; i < sizeof(values); i++) {
+                sample(values[i], 16 << ADC_FILTER_SHIFT);
+                TEST_ASSERT_EQUAL(values[i], cv());
+        }
+}
+
+/* test_adc_noise
+ * --------------
+ * Description:
+ *      Noise is smoothed out, the reading remaining
+ *      within the range of the noisy input.
+ */
+void test_adc_noise()
+{
+        sample(100, 16 << ADC_FILTER_SHIFT);
+
+        for (uint16_t i = 0; i < 256; i++) {
+                sample((i & 1) ? 110 : 100, 1);
+                TEST_ASSERT_INT_WITHIN(5, 105, cv());
+        }
+}
+
+/* test_adc_blocking_read
+ * ----------------------
+ * Description:
+ *      Blocking conversions of other channels, including the
+ *      supply voltage check, pause the sampler, which then
+ *      resumes at its own channel.
+ */
+void test_adc_blocking_read()
+{
+        adc_avg((1 << MUX3) | (1 << MUX2), 4);
+
+        TEST_ASSERT_EQUAL(CV_INPUT_ADMUX_MSK, ADMUX & MUX_MSK);
+        TEST_ASSERT_TRUE(ADCSRA & (1 << ADIE));
+        TEST_ASSERT_TRUE(ADCSRA & (1 << ADATE));
+
+        ADCH = 56;
+        TEST_ASSERT_TRUE(supply_ok());
+
+        TEST_ASSERT_EQUAL(CV_INPUT_ADMUX_MSK, ADMUX & MUX_MSK);
+        TEST_ASSERT_TRUE(ADCSRA & (1 << ADIE));
+        TEST_ASSERT_TRUE(ADCSRA & (1 << ADATE));
+        TEST_ASSERT_EQUAL(200, cv());
+}
+
+int main(int argc, char *argv[])
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_adc_seed);
+        RUN_TEST(test_adc_step);
+        RUN_TEST(test_adc_settle);
+        RUN_TEST(test_adc_noise);
+        RUN_TEST(test_adc_blocking_read);
+        return UNITY_END();
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Tests the commit of the patch selected at power-up.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <unity.h>
+
+#include "config.h"
+#include "effect.h"
+#include "settings.h"
+#include "hal/native/native.h"
+
+// Boot routines of main.cpp
+uint8_t boot_select();
+bool boot_commit();
+
+// ADC readings of the bandgap reference (see supply_ok())
+#define ADC_VCC_5V 56           // 1.1 V / 5 V * 256
+#define ADC_VCC_COLLAPSED 255
+
+void setUp()
+{
+        native_reset();
+        ADCH = ADC_VCC_5V;
+        settings_load();
+        eeprom_settings.patch = 0;
+        TEST_ASSERT_TRUE(settings_save());
+}
+
+void tearDown() {}
+
+/* power_up
+ * --------
+ * Returns:
+ *      Patch selected at power-up
+ * Description:
+ *      Simulates a power cycle, loading the settings
+ *      and selecting the patch to be shown.
+ */
+static uint8_t power_up()
+{
+        native_reset();
+        ADCH = ADC_VCC_5V;
+        settings_load();
+        return boot_select();
+}
+
+/* run
+ * ---
+ * Parameters:
+ *      ms - Time in ms
+ * Description:
+ *      Polls boot_commit() every millisecond for the given time,
+ *      as the main loop does.
+ */
+static void run(unsigned long ms)
+{
+        while (ms--) {
+                native_advance_ms(1);
+                boot_commit();
+        }
+}
+
+/* test_boot_cut_short
+ * -------------------
+ * Description:
+ *      Power cycles cut short before BOOT_COMMIT_MS
+ *      neither write to the EEPROM, nor skip a patch.
+ */
+void test_boot_cut_short()
+{
+        for (uint8_t i = 0; i < 10; i++) {
+                native_eeprom_budget = 0;
+
+                TEST_ASSERT_EQUAL(1 % NUM_PATCHES, power_up());
+                run(BOOT_COMMIT_MS - 1);
+
+                TEST_ASSERT_FALSE(boot_commit());
+                TEST_ASSERT_EQUAL(0, native_eeprom_lost);
+        }
+}
+
+/* test_boot_commit
+ * ----------------
+ * Description:
+ *      Once it has been running for BOOT_COMMIT_MS, the patch
+ *      selected at power-up is committed, and the next power-up
+ *      selects the following patch, wrapping around after the
+ *      last one.
+ */
+void test_boot_commit()
+{
+        for (uint8_t i = 1; i <= 2 * NUM_PATCHES; i++) {
+                TEST_ASSERT_EQUAL(i % NUM_PATCHES, power_up());
+                run(BOOT_COMMIT_MS);
+                TEST_ASSERT_TRUE(boot_commit());
+        }
+}
+
+/* test_boot_low_supply
+ * --------------------
+ * Description:
+ *      A commit aborted due to a low supply leaves the previous
+ *      selection in effect, and is retried BOOT_COMMIT_MS later.
+ */
+void test_boot_low_supply()
+{
+        TEST_ASSERT_EQUAL(1 % NUM_PATCHES, power_up());
+
+        ADCH = ADC_VCC_COLLAPSED;
+        run(BOOT_COMMIT_MS);
+        TEST_ASSERT_FALSE(boot_commit());
+
+        // The supply recovers
+        ADCH = ADC_VCC_5V;
+        run(BOOT_COMMIT_MS - 1);
+        TEST_ASSERT_FALSE(boot_commit());
+        run(1);
+        TEST_ASSERT_TRUE(boot_commit());
+
+        TEST_ASSERT_EQUAL(2 % NUM_PATCHES, power_up());
+}
+
+/* test_boot_power_lost
+ * --------------------
+ * Description:
+ *      A commit aborted by a power loss reselects the
+ *      same patch at the next power-up.
+ */
+void test_boot_power_lost()
+{
+        TEST_ASSERT_EQUAL(1 % NUM_PATCHES, power_up());
+
+        ADCH = ADC_VCC_COLLAPSED;
+        run(BOOT_COMMIT_MS);
+        TEST_ASSERT_FALSE(boot_commit());
+
+        TEST_ASSERT_EQUAL(1 % NUM_PATCHES, power_up());
+}
+
+int main(int argc, char *argv[])
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_boot_cut_short);
+        RUN_TEST(test_boot_commit);
+        RUN_TEST(test_boot_low_supply);
+        RUN_TEST(test_boot_power_lost);
+        return UNITY_END();
+}
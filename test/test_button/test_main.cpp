@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Tests the gesture state machine of the push button.
+ *
+ */
+
+#include <stdint.h>
+
+#include <avr/io.h>
+#include <unity.h>
+
+#include "config.h"
+#include "input.h"
+#include "timer.h"
+#include "hal/native/native.h"
+
+#define MAX_EVENTS 16
+
+static uint8_t events[MAX_EVENTS];              // Queued events, in order
+static unsigned long event_ms[MAX_EVENTS];      // Time of each event, relative to the test's start
+static uint8_t num_events;
+static unsigned long start;
+
+void PCINT0_vect(void);                         // Pin change interrupt, a plain function on native builds
+
+/* run
+ * ---
+ * Parameters:
+ *      ms - Time in ms
+ * Description:
+ *      Polls button_event() every millisecond for the given
+ *      time, as the main loop does, recording every event.
+ */
+static void run(unsigned long ms)
+{
+        while (ms--) {
+                uint8_t event;
+
+                while ((event = button_event()) != BTN_NONE) {
+                        TEST_ASSERT_LESS_THAN(MAX_EVENTS, num_events);
+                        events[num_events] = event;
+                        event_ms[num_events] = millis() - start;
+                        num_events++;
+                }
+
+                native_advance_ms(1);
+        }
+}
+
+/* drive
+ * -----
+ * Parameters:
+ *      pressed - Whether the button is pressed
+ * Description:
+ *      Drives the button pin, which is pulled up, raising
+ *      the pin change interrupt if its level changes.
+ */
+static void drive(bool pressed)
+{
+        uint8_t pinb = PINB;
+
+        if (pressed)
+                PINB &= ~(1 << BTN);
+        else
+                PINB |= (1 << BTN);
+
+        if (PINB != pinb)
+                PCINT0_vect();
+}
+
+/* press
+ * -----
+ * Parameters:
+ *      pressed - Whether the button is pressed
+ *      ms - Time in ms the button remains in this state
+ * Description:
+ *      Drives the button pin and runs for the given time.
+ */
+static void press(bool pressed, unsigned long ms)
+{
+        drive(pressed);
+        run(ms);
+}
+
+void setUp()
+{
+        // Let any previous gesture complete
+        press(false, 2 * BTN_DOUBLE_CLICK_MS + BTN_DEBOUNCE_TIME);
+
+        num_events = 0;
+        start = millis();
+}
+
+void tearDown() {}
+
+/* test_button_click
+ * -----------------
+ * Description:
+ *      A bouncy press is queued as a single click on its
+ *      release, bounces within BTN_DEBOUNCE_TIME being ignored.
+ */
+void test_button_click()
+{
+        press(true, 2);
+        press(false, 1);
+        press(true, 2);
+        press(false, 1);
+        press(true, 74);                        // Released at 80 ms
+        press(false, 2);
+        press(true, 1);                         // Release bounce
+        press(false, BTN_DOUBLE_CLICK_MS);
+
+        TEST_ASSERT_EQUAL(1, num_events);
+        TEST_ASSERT_EQUAL(BTN_CLICK, events[0]);
+        TEST_ASSERT_EQUAL(BTN_DEBOUNCE_TIME, event_ms[0]);
+}
+
+/* test_button_double_click
+ * ------------------------
+ * Description:
+ *      A press within BTN_DOUBLE_CLICK_MS of a click is queued as
+ *      a double click. A third click starts over, and clicks
+ *      further apart are queued as single clicks.
+ */
+void test_button_double_click()
+{
+        press(true, 150);
+        press(false, 150);
+        press(true, 150);                       // Double click
+        press(false, 150);
+        press(true, 150);                       // Starts over
+        press(false, BTN_DOUBLE_CLICK_MS + 200);
+        press(true, 150);                       // Too late for a double click
+        press(false, 150);
+
+        TEST_ASSERT_EQUAL(4, num_events);
+        TEST_ASSERT_EQUAL(BTN_CLICK, events[0]);
+        TEST_ASSERT_EQUAL(BTN_DOUBLE_CLICK, events[1]);
+        TEST_ASSERT_EQUAL(BTN_CLICK, events[2]);
+        TEST_ASSERT_EQUAL(BTN_CLICK, events[3]);
+}
+
+/* test_button_long_press
+ * ----------------------
+ * Description:
+ *      Holding the button queues a long press after BTN_LONG_PRESS_MS,
+ *      followed by a hold every BTN_HOLD_REPEAT_MS. The release of a
+ *      long press queues nothing.
+ */
+void test_button_long_press()
+{
+        const unsigned long held = BTN_LONG_PRESS_MS + 2 * BTN_HOLD_REPEAT_MS + 1;
+
+        press(true, held);
+        TEST_ASSERT_EQUAL(held, button_held());
+        press(false, 2 * BTN_DOUBLE_CLICK_MS);
+        TEST_ASSERT_EQUAL(0, button_held());
+
+        TEST_ASSERT_EQUAL(3, num_events);
+        TEST_ASSERT_EQUAL(BTN_LONG_PRESS, events[0]);
+        TEST_ASSERT_EQUAL(BTN_LONG_PRESS_MS, event_ms[0]);
+        TEST_ASSERT_EQUAL(BTN_HOLD, events[1]);
+        TEST_ASSERT_EQUAL(BTN_LONG_PRESS_MS + BTN_HOLD_REPEAT_MS, event_ms[1]);
+        TEST_ASSERT_EQUAL(BTN_HOLD, events[2]);
+        TEST_ASSERT_EQUAL(BTN_LONG_PRESS_MS + 2 * BTN_HOLD_REPEAT_MS, event_ms[2]);
+}
+
+/* test_button_click_after_long_press
+ * ----------------------------------
+ * Description:
+ *      A click right after a long press is a single click.
+ */
+void test_button_click_after_long_press()
+{
+        press(true, BTN_LONG_PRESS_MS + 1);
+        press(false, 150);
+        press(true, 150);
+        press(false, 150);
+
+        TEST_ASSERT_EQUAL(2, num_events);
+        TEST_ASSERT_EQUAL(BTN_LONG_PRESS, events[0]);
+        TEST_ASSERT_EQUAL(BTN_CLICK, events[1]);
+}
+
+/* test_button_click_between_polls
+ * -------------------------------
+ * Description:
+ *      A click is queued by the pin change interrupt, even if
+ *      the button is pressed and released between two polls.
+ */
+void test_button_click_between_polls()
+{
+        drive(true);
+        native_advance_ms(150);
+        drive(false);
+        native_advance_ms(150);
+        run(1);
+
+        TEST_ASSERT_EQUAL(1, num_events);
+        TEST_ASSERT_EQUAL(BTN_CLICK, events[0]);
+}
+
+int main(int argc, char *argv[])
+{
+        native_reset();
+
+        UNITY_BEGIN();
+        RUN_TEST(test_button_click);
+        RUN_TEST(test_button_double_click);
+        RUN_TEST(test_button_long_press);
+        RUN_TEST(test_button_click_after_long_press);
+        RUN_TEST(test_button_click_between_polls);
+        return UNITY_END();
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Tests the temporal dithering of gamma corrected values.
+ *              Built by the native_dither environment, which enables
+ *              WS2812_GAMMA and WS2812_DITHER.
+ *
+ */
+
+#include <stdint.h>
+
+#include <avr/pgmspace.h>
+#include <unity.h>
+
+#include "ws2812.h"
+#include "strip.h"
+#include "hal/native/native.h"
+
+#if !defined(WS2812_GAMMA) || !defined(WS2812_DITHER)
+#error "test_dither requires WS2812_GAMMA and WS2812_DITHER (see native_dither in platformio.ini)"
+#endif
+
+// Sum of the first byte of every transmitted frame
+static unsigned long frame_sum;
+
+static void sum_frame(const uint8_t *frame, uint16_t len)
+{
+        if (len)
+                frame_sum += frame[0];
+}
+
+void setUp()
+{
+        native_reset();
+        native_frame_sink = sum_frame;
+        strip_size = 8;
+}
+
+void tearDown()
+{
+        native_frame_sink = NULL;
+}
+
+/* show
+ * ----
+ * Parameters:
+ *      v - Value of every color channel
+ *      n - Number of times the frame is applied
+ * Returns:
+ *      Number of frames transmitted
+ * Description:
+ *      Applies the same static frame n times,
+ *      summing up the transmitted values.
+ */
+static unsigned long show(uint8_t v, uint16_t n)
+{
+        RGB_t rgb = {v, v, v};
+        unsigned long frames = native_frames_tx;
+
+        frame_sum = 0;
+        for (uint16_t i = 0; i < n; i++)
+                strip_apply_all(rgb);
+
+        return native_frames_tx - frames;
+}
+
+/* test_dither_average
+ * -------------------
+ * Description:
+ *      Over 256 successive frames, every dither threshold is used
+ *      once. The transmitted values must thus add up to exactly
+ *      the 8.8 fixed point gamma corrected value.
+ */
+void test_dither_average()
+{
+        for (uint16_t v = 0; v < 256; v++) {
+                uint16_t expected = pgm_read_word(&ws2812_gamma[v]);
+
+                show(v, 1);     // Leaves the residual of the value
+                if (!WS2812_DITHERING)
+                        continue;
+
+                TEST_ASSERT_EQUAL(256, show(v, 256));
+                TEST_ASSERT_EQUAL_UINT32(expected, frame_sum);
+        }
+}
+
+/* test_dither_skips_exact
+ * -----------------------
+ * Description:
+ *      Values without a fractional part leave no residual,
+ *      and repeated static frames are skipped.
+ */
+void test_dither_skips_exact()
+{
+        for (uint16_t v = 0; v < 256; v++) {
+                uint16_t expected = pgm_read_word(&ws2812_gamma[v]);
+
+                if (expected & 0xFF)
+                        continue;
+
+                show(v, 1);
+                TEST_ASSERT_FALSE(WS2812_DITHERING);
+                TEST_ASSERT_EQUAL(0, show(v, 16));
+        }
+}
+
+/* test_dither_refreshes_fraction
+ * ------------------------------
+ * Description:
+ *      Static frames with a fractional part keep being
+ *      transmitted, so the strip shows their average.
+ */
+void test_dither_refreshes_fraction()
+{
+        // round(0xFF00 * (128 / 255)^2.8) = 9477, 0x25 + 0x05/0x100
+        TEST_ASSERT_EQUAL_UINT16(9477, pgm_read_word(&ws2812_gamma[128]));
+
+        show(128, 1);
+        TEST_ASSERT_TRUE(WS2812_DITHERING);
+        TEST_ASSERT_EQUAL(16, show(128, 16));
+}
+
+int main(int argc, char *argv[])
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_dither_average);
+        RUN_TEST(test_dither_skips_exact);
+        RUN_TEST(test_dither_refreshes_fraction);
+        return UNITY_END();
+}
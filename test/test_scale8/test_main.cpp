@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Compares the fixed point color math against the
+ *              floating point arithmetic it replaced.
+ *
+ */
+
+#include <math.h>
+#include <stdint.h>
+
+#include <unity.h>
+
+#include "color.h"
+
+void setUp() {}
+void tearDown() {}
+
+/* test_scale8_matches_float
+ * -------------------------
+ * Description:
+ *      scale8() must stay within +-1 of the floating point scaling
+ *      round(((double)scale/255) * i) it replaced, for all inputs.
+ */
+void test_scale8_matches_float()
+{
+        for (uint16_t i = 0; i < 256; i++) {
+                for (uint16_t scale = 0; scale < 256; scale++) {
+                        long expected = lround(((double)scale / 255) * i);
+                        TEST_ASSERT_INT_WITHIN(1, expected, scale8(i, scale));
+                }
+        }
+}
+
+/* test_scale8_bounds
+ * ------------------
+ * Description:
+ *      A scale of 255 must leave values untouched,
+ *      and a scale of 0 must turn them off.
+ */
+void test_scale8_bounds()
+{
+        for (uint16_t i = 0; i < 256; i++) {
+                TEST_ASSERT_EQUAL_UINT8(i, scale8(i, 255));
+                TEST_ASSERT_EQUAL_UINT8(0, scale8(i, 0));
+                TEST_ASSERT_EQUAL_UINT8(0, scale8(0, i));
+        }
+}
+
+int main(int argc, char *argv[])
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_scale8_matches_float);
+        RUN_TEST(test_scale8_bounds);
+        return UNITY_END();
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2020  Patrick Pedersen
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Patrick Pedersen <ctx.xda@gmail.com>
+ * Description: Tests the settings journal against power cycles,
+ *              torn writes and supply voltage drops.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <unity.h>
+
+#include "settings.h"
+#include "hal/native/native.h"
+
+// Mirrors the record layout of settings.cpp
+#define REC_SIZE 5
+#define RING_SLOTS ((E2END + 1) / REC_SIZE)
+
+extern uint8_t settings_ring[RING_SLOTS][REC_SIZE];
+
+// ADC readings of the bandgap reference (see supply_ok())
+#define ADC_VCC_5V 56           // 1.1 V / 5 V * 256
+#define ADC_VCC_COLLAPSED 255
+
+void setUp()
+{
+        native_reset();
+        ADCH = ADC_VCC_5V;
+        memset(settings_ring, 0xFF, sizeof(settings_ring));
+        settings_load();
+}
+
+void tearDown() {}
+
+/* boot
+ * ----
+ * Description:
+ *      Simulates a power cycle, loading the
+ *      settings from the journal alone.
+ */
+static void boot()
+{
+        eeprom_settings.patch = 0xAA;
+        eeprom_settings.strip_size = 0xAAAA;
+        settings_load();
+}
+
+/* test_settings_blank
+ * -------------------
+ * Description:
+ *      Erased and zeroed EEPROMs hold no valid record,
+ *      leaving the strip uncalibrated at the first patch.
+ */
+void test_settings_blank()
+{
+        boot();
+        TEST_ASSERT_EQUAL(0, eeprom_settings.patch);
+        TEST_ASSERT_EQUAL(0, eeprom_settings.strip_size);
+
+        memset(settings_ring, 0, sizeof(settings_ring));
+        boot();
+        TEST_ASSERT_EQUAL(0, eeprom_settings.patch);
+        TEST_ASSERT_EQUAL(0, eeprom_settings.strip_size);
+}
+
+/* test_settings_power_cycles
+ * --------------------------
+ * Description:
+ *      Saves and reloads the settings across many laps of the ring.
+ *      Every load must return the latest save, and every cell must
+ *      only be written once per lap.
+ */
+void test_settings_power_cycles()
+{
+        static unsigned long writes[RING_SLOTS][REC_SIZE];
+        const unsigned long boots = 100UL * RING_SLOTS;
+
+        memset(writes, 0, sizeof(writes));
+
+        for (unsigned long i = 0; i < boots; i++) {
+                uint8_t before[RING_SLOTS][REC_SIZE];
+                uint8_t patch = i % 3;
+                uint16_t size = 1 + i % 300;
+
+                memcpy(before, settings_ring, sizeof(before));
+
+                eeprom_settings.patch = patch;
+                eeprom_settings.strip_size = size;
+                TEST_ASSERT_TRUE(settings_save());
+
+                boot();
+                TEST_ASSERT_EQUAL(patch, eeprom_settings.patch);
+                TEST_ASSERT_EQUAL(size, eeprom_settings.strip_size);
+
+                for (uint8_t s = 0; s < RING_SLOTS; s++)
+                        for (uint8_t b = 0; b < REC_SIZE; b++)
+                                writes[s][b] += (before[s][b] != settings_ring[s][b]);
+        }
+
+        for (uint8_t s = 0; s < RING_SLOTS; s++)
+                for (uint8_t b = 0; b < REC_SIZE; b++)
+                        TEST_ASSERT_LESS_OR_EQUAL(boots / RING_SLOTS + 1, writes[s][b]);
+}
+
+/* test_settings_torn_write
+ * ------------------------
+ * Description:
+ *      Cuts the power after every possible write of saves of
+ *      every patch, across several laps of the ring. Unless
+ *      the save has completed, the previous settings must
+ *      remain in effect.
+ */
+void test_settings_torn_write()
+{
+        static uint8_t before[RING_SLOTS][REC_SIZE];
+        uint8_t prev_patch = 0;
+        uint16_t prev_size = 0;
+
+        for (unsigned long i = 0; i < 3UL * RING_SLOTS; i++) {
+                uint16_t size = 1 + i % 300;
+
+                memcpy(before, settings_ring, sizeof(before));
+
+                for (uint8_t patch = 0; patch < 3; patch++) {
+                        for (long cut = 0; cut < REC_SIZE; cut++) {
+                                eeprom_settings.patch = patch;
+                                eeprom_settings.strip_size = size;
+                                native_eeprom_budget = cut;
+                                native_eeprom_lost = 0;
+                                settings_save();
+                                native_eeprom_budget = -1;
+
+                                boot();
+
+                                if (native_eeprom_lost) {
+                                        TEST_ASSERT_EQUAL(prev_patch, eeprom_settings.patch);
+                                        TEST_ASSERT_EQUAL(prev_size, eeprom_settings.strip_size);
+                                }
+
+                                memcpy(settings_ring, before, sizeof(before));
+                                boot();
+                        }
+                }
+
+                eeprom_settings.patch = i % 3;
+                eeprom_settings.strip_size = size;
+                TEST_ASSERT_TRUE(settings_save());
+
+                boot();
+                TEST_ASSERT_EQUAL(i % 3, eeprom_settings.patch);
+                TEST_ASSERT_EQUAL(size, eeprom_settings.strip_size);
+
+                prev_patch = i % 3;
+                prev_size = size;
+        }
+}
+
+/* test_settings_low_supply
+ * ------------------------
+ * Description:
+ *      A collapsing supply aborts the save before anything
+ *      is written. Once the supply recovers, the save succeeds.
+ */
+void test_settings_low_supply()
+{
+        uint8_t before[RING_SLOTS][REC_SIZE];
+
+        memcpy(before, settings_ring, sizeof(before));
+
+        eeprom_settings.patch = 2;
+        eeprom_settings.strip_size = 30;
+        ADCH = ADC_VCC_COLLAPSED;
+        TEST_ASSERT_FALSE(settings_save());
+        TEST_ASSERT_EQUAL_MEMORY(before, settings_ring, sizeof(before));
+
+        ADCH = ADC_VCC_5V;
+        TEST_ASSERT_TRUE(settings_save());
+        boot();
+        TEST_ASSERT_EQUAL(2, eeprom_settings.patch);
+        TEST_ASSERT_EQUAL(30, eeprom_settings.strip_size);
+}
+
+/* test_settings_unchanged
+ * -----------------------
+ * Description:
+ *      Saving unchanged settings writes nothing.
+ */
+void test_settings_unchanged()
+{
+        uint8_t before[RING_SLOTS][REC_SIZE];
+
+        eeprom_settings.patch = 1;
+        eeprom_settings.strip_size = 8;
+        TEST_ASSERT_TRUE(settings_save());
+        boot();
+
+        memcpy(before, settings_ring, sizeof(before));
+        TEST_ASSERT_TRUE(settings_save());
+        TEST_ASSERT_EQUAL_MEMORY(before, settings_ring, sizeof(before));
+}
+
+int main(int argc, char *argv[])
+{
+        UNITY_BEGIN();
+        RUN_TEST(test_settings_blank);
+        RUN_TEST(test_settings_power_cycles);
+        RUN_TEST(test_settings_torn_write);
+        RUN_TEST(test_settings_low_supply);
+        RUN_TEST(test_settings_unchanged);
+        return UNITY_END();
+}